@@ -0,0 +1,116 @@
+// Micro-benchmark of the bus address decoding: compares the
+// std::map-based lookup previously used by Bus and FastBus with
+// ensitlm::addr_decoder, on the address map of the TP2 platform.
+//
+// Usage: ./decode.x [number of lookups]
+
+#include "ensitlm.h"
+#include "addr_decoder.h"
+#include "address_map.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+// The decoding structure used before, kept here as a reference.
+class addr_range {
+public:
+	addr_range(ensitlm::addr_t b, ensitlm::addr_t e) : begin(b), end(e) {
+	}
+	const ensitlm::addr_t begin;
+	const ensitlm::addr_t end;
+	bool operator<(const addr_range &ar) const {
+		return (end < ar.begin);
+	}
+};
+
+typedef std::map<addr_range, int> addr_map_t;
+
+struct mapping {
+	ensitlm::addr_t base;
+	ensitlm::addr_t size;
+};
+
+static const mapping platform[] = {
+    {INST_RAM_BASEADDR, INST_RAM_SIZE}, {VGA_BASEADDR, VGA_SIZE},
+    {GPIO_BASEADDR, GPIO_SIZE},         {UART_BASEADDR, UART_SIZE},
+    {TIMER_BASEADDR, TIMER_SIZE},       {INTC_BASEADDR, INTC_SIZE},
+};
+
+static const int nb_mappings = sizeof(platform) / sizeof(platform[0]);
+
+template <typename F> static double measure(const char *what, F f) {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	unsigned long sum = f();
+	chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+	double ns = chrono::duration<double, nano>(stop - start).count();
+	// Print the checksum so that the lookups are not optimized away.
+	cout << what << ": " << ns / 1e6 << " ms (checksum " << sum << ")"
+	     << endl;
+	return ns;
+}
+
+int main(int argc, char **argv) {
+	unsigned int n = argc > 1 ? strtoul(argv[1], NULL, 0) : 10000000;
+
+	addr_map_t addr_map;
+	ensitlm::addr_decoder decoder;
+	for (int i = 0; i < nb_mappings; ++i) {
+		ensitlm::addr_t b = platform[i].base;
+		ensitlm::addr_t e = b + platform[i].size - 1;
+		addr_map.insert(std::pair<addr_range, int>(addr_range(b, e), i));
+		if (decoder.add(b, e, i) >= 0) {
+			cerr << "unexpected conflict" << endl;
+			return 1;
+		}
+	}
+	decoder.build();
+
+	// Mostly instruction RAM accesses, like the ISS, with some
+	// peripheral accesses.
+	vector<ensitlm::addr_t> addrs(4096);
+	srand(42);
+	for (unsigned int i = 0; i < addrs.size(); ++i) {
+		const mapping &m = platform[rand() % 8 < 6 ? 0 : rand() %
+		                                                 nb_mappings];
+		addrs[i] = m.base + (rand() % m.size & ~3u);
+	}
+
+	for (unsigned int i = 0; i < addrs.size(); ++i) {
+		addr_map_t::iterator it =
+		    addr_map.find(addr_range(addrs[i], addrs[i]));
+		const ensitlm::addr_decoder::range *r = decoder.find(addrs[i]);
+		if (!r || it == addr_map.end() || r->port != (*it).second ||
+		    r->begin != (*it).first.begin) {
+			cerr << "decoders disagree at " << hex << addrs[i]
+			     << endl;
+			return 1;
+		}
+	}
+
+	cout << n << " lookups over " << nb_mappings << " ranges" << endl;
+	double before = measure("std::map", [&]() {
+		unsigned long sum = 0;
+		for (unsigned int i = 0; i < n; ++i) {
+			ensitlm::addr_t a = addrs[i % addrs.size()];
+			sum += (*addr_map.find(addr_range(a, a))).second;
+		}
+		return sum;
+	});
+	double after = measure("addr_decoder", [&]() {
+		unsigned long sum = 0;
+		for (unsigned int i = 0; i < n; ++i) {
+			ensitlm::addr_t a = addrs[i % addrs.size()];
+			sum += decoder.find(a)->port;
+		}
+		return sum;
+	});
+	cout << "std::map: " << before / n << " ns/lookup, addr_decoder: "
+	     << after / n << " ns/lookup (x" << before / after << ")"
+	     << endl;
+	return 0;
+}
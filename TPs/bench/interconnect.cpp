@@ -0,0 +1,216 @@
+// Micro-benchmark of the interconnects: a synthetic initiator reads and
+// writes synthetic targets (three reads for one write, without DMI)
+// bound directly, through Bus or through FastBus, with 1 to 64 mapped
+// ranges and sequential or random addresses. For each configuration,
+// the host time per transaction is measured 5 times, and the median
+// and best ones are reported.
+//
+// Usage: ./interconnect.x [transactions per measure]
+//
+// A SystemC simulation can only be elaborated once per process: each
+// configuration runs in a child process, which reports its measures
+// through a pipe (its standard output, with the messages of the
+// modules, is discarded). Set ENSITLM_FORCE_TLM=1 to measure
+// b_transport instead of the direct calls of the ensitlm sockets.
+
+#include "ensitlm.h"
+#include "bus.h"
+#include "fast-bus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+static const unsigned int repeats = 5;
+// Each target is mapped on a range of this size.
+static const ensitlm::addr_t range_size = 0x10000;
+
+struct Target : sc_core::sc_module {
+	ensitlm::target_socket<Target> target;
+
+	Target(sc_core::sc_module_name name)
+	    : sc_core::sc_module(name),
+	      storage(range_size / sizeof(ensitlm::data_t)) {
+	}
+
+	tlm::tlm_response_status read(const ensitlm::addr_t &a,
+	                              ensitlm::data_t &d) {
+		d = storage[a / sizeof(ensitlm::data_t)];
+		return tlm::TLM_OK_RESPONSE;
+	}
+
+	tlm::tlm_response_status write(const ensitlm::addr_t &a,
+	                               const ensitlm::data_t &d) {
+		storage[a / sizeof(ensitlm::data_t)] = d;
+		return tlm::TLM_OK_RESPONSE;
+	}
+
+	vector<ensitlm::data_t> storage;
+};
+
+struct Initiator : sc_core::sc_module {
+	ensitlm::initiator_socket<Initiator> socket;
+
+	SC_HAS_PROCESS(Initiator);
+	Initiator(sc_core::sc_module_name name,
+	          const vector<ensitlm::addr_t> &addrs, unsigned int n)
+	    : sc_core::sc_module(name), addrs(addrs), n(n), checksum(0) {
+		SC_THREAD(run);
+	}
+
+	void run() {
+		for (unsigned int r = 0; r < repeats; ++r) {
+			chrono::steady_clock::time_point start =
+			    chrono::steady_clock::now();
+			for (unsigned int i = 0; i < n; ++i) {
+				ensitlm::addr_t a = addrs[i % addrs.size()];
+				ensitlm::data_t d = i;
+				if (i & 3)
+					socket.read(a, d);
+				else
+					socket.write(a, d);
+				checksum += d;
+			}
+			chrono::steady_clock::time_point stop =
+			    chrono::steady_clock::now();
+			chrono::duration<double, nano> elapsed = stop - start;
+			ns.push_back(elapsed.count() / n);
+		}
+		sc_core::sc_stop();
+	}
+
+	const vector<ensitlm::addr_t> &addrs;
+	unsigned int n;
+	ensitlm::data_t checksum;
+	vector<double> ns;
+};
+
+struct config {
+	const char *interconnect;
+	unsigned int targets;
+	bool random;
+};
+
+static const config configs[] = {
+    {"direct", 1, false},   {"direct", 1, true},    {"Bus", 1, false},
+    {"Bus", 1, true},       {"Bus", 4, false},      {"Bus", 4, true},
+    {"Bus", 16, false},     {"Bus", 16, true},      {"Bus", 64, false},
+    {"Bus", 64, true},      {"FastBus", 1, false},  {"FastBus", 1, true},
+    {"FastBus", 4, false},  {"FastBus", 4, true},   {"FastBus", 16, false},
+    {"FastBus", 16, true},  {"FastBus", 64, false}, {"FastBus", 64, true},
+};
+
+// Addresses accessed, word by word over all the ranges, or at random
+// (with a fixed seed) among them.
+static vector<ensitlm::addr_t> addresses(const config &c) {
+	ensitlm::addr_t space = c.targets * range_size;
+	vector<ensitlm::addr_t> addrs(1 << 20);
+	srand(42);
+	for (unsigned int i = 0; i < addrs.size(); ++i)
+		addrs[i] = c.random ? (rand() % space) & ~3u
+		                    : i * 4 % space;
+	return addrs;
+}
+
+template <typename BUS>
+static void bind(BUS &bus, Initiator &initiator, vector<Target *> &targets) {
+	initiator.socket.bind(bus.target);
+	for (unsigned int i = 0; i < targets.size(); ++i) {
+		bus.initiator(targets[i]->target);
+		bus.map(targets[i]->target, i * range_size, range_size);
+	}
+}
+
+// Run one configuration, and write the median and best times to fd.
+static void simulate(const config &c, unsigned int n, int fd) {
+	vector<ensitlm::addr_t> addrs = addresses(c);
+	Initiator initiator("initiator", addrs, n);
+	vector<Target *> targets;
+	for (unsigned int i = 0; i < c.targets; ++i)
+		targets.push_back(
+		    new Target(sc_core::sc_gen_unique_name("target")));
+
+	if (strcmp(c.interconnect, "Bus") == 0)
+		bind(*new Bus("bus"), initiator, targets);
+	else if (strcmp(c.interconnect, "FastBus") == 0)
+		bind(*new FastBus("bus"), initiator, targets);
+	else
+		initiator.socket.bind(targets[0]->target);
+
+	sc_core::sc_start();
+
+	vector<double> ns = initiator.ns;
+	sort(ns.begin(), ns.end());
+	dprintf(fd, "%f %f\n", ns[ns.size() / 2], ns[0]);
+}
+
+// Run c in a child process, return false if it failed.
+static bool measure(const config &c, unsigned int n, double &median,
+                    double &best) {
+	int fds[2];
+	if (pipe(fds)) {
+		perror("pipe");
+		return false;
+	}
+	cout.flush();
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return false;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		simulate(c, n, fds[1]);
+		_exit(0);
+	}
+	close(fds[1]);
+	char buf[128];
+	ssize_t got = read(fds[0], buf, sizeof(buf) - 1);
+	close(fds[0]);
+	int status;
+	waitpid(pid, &status, 0);
+	if (got <= 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+		return false;
+	buf[got] = '\0';
+	return sscanf(buf, "%lf %lf", &median, &best) == 2;
+}
+
+int sc_main(int argc, char **argv) {
+	unsigned int n = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+
+	cout << n << " transactions per measure, best and median of "
+	     << repeats << (ensitlm::force_tlm() ? ", through b_transport"
+	                                         : ", with direct calls")
+	     << "\n\n"
+	     << left << setw(14) << "interconnect" << right << setw(8)
+	     << "targets" << setw(12) << "addresses" << setw(14)
+	     << "ns (median)" << setw(12) << "ns (best)" << setw(12)
+	     << "Mtrans/s" << endl;
+	cout << fixed << setprecision(1);
+	for (unsigned int i = 0; i < sizeof(configs) / sizeof(configs[0]);
+	     ++i) {
+		const config &c = configs[i];
+		cout << left << setw(14) << c.interconnect << right << setw(8)
+		     << c.targets << setw(12)
+		     << (c.random ? "random" : "sequential");
+		double median, best;
+		if (measure(c, n, median, best))
+			cout << setw(14) << median << setw(12) << best
+			     << setw(12) << 1e3 / median << endl;
+		else
+			cout << setw(14) << "failed" << endl;
+	}
+	return 0;
+}
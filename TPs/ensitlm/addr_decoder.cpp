@@ -0,0 +1,55 @@
+#include "addr_decoder.h"
+
+#include <algorithm>
+
+namespace ensitlm {
+
+static bool ends_before(const addr_decoder::range &r, addr_t a) {
+	return r.end < a;
+}
+
+static bool begins_after(addr_t a, const addr_decoder::range &r) {
+	return a < r.begin;
+}
+
+addr_decoder::addr_decoder() : pages(1u << (32 - page_bits), 0) {
+	// The sentinel has begin > end, hence contains no address.
+	range sentinel = {1, 0, -1};
+	ranges.push_back(sentinel);
+}
+
+int addr_decoder::add(addr_t begin, addr_t end, int port) {
+	std::vector<range>::iterator it =
+	    std::lower_bound(ranges.begin(), ranges.end() - 1, begin,
+	                     ends_before);
+	if (it != ranges.end() - 1 && (*it).begin <= end)
+		return (*it).port;
+	range r = {begin, end, port};
+	ranges.insert(it, r);
+	return -1;
+}
+
+void addr_decoder::build() {
+	unsigned int n = ranges.size() - 1;
+	unsigned int i = 0;
+	for (unsigned int p = 0; p < pages.size(); ++p) {
+		addr_t start = addr_t(p) << page_bits;
+		while (i < n && ranges[i].end < start)
+			++i;
+		pages[p] = i;
+	}
+}
+
+// The page table gives the first range ending in or after the page of
+// a: the range containing a, if any, is this one or a following one.
+const addr_decoder::range *addr_decoder::find_slow(addr_t a,
+                                                   unsigned int first) const {
+	const_iterator b = ranges.begin() + first;
+	const_iterator it = std::upper_bound(b, ranges.end() - 1, a,
+	                                     begins_after);
+	if (it == b)
+		return NULL;
+	--it;
+	return a <= (*it).end ? &*it : NULL;
+}
+}
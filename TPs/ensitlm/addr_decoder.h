@@ -0,0 +1,68 @@
+#ifndef ENSITLM_ADDR_DECODER_H
+#define ENSITLM_ADDR_DECODER_H
+
+#include "ensitlm.h"
+
+#include <vector>
+
+namespace ensitlm {
+
+// Address decoder shared by the buses.
+//
+// The address ranges are kept in an array sorted by address, and a
+// page table over the 32-bit address space (one entry per 64 KiB page)
+// gives, for each page, the first range which may contain an address
+// of this page. Decoding an address thus usually costs one lookup in
+// the page table and one comparison. Ranges smaller than a page, or not
+// aligned on pages, are found by a binary search restricted to the
+// ranges following the one given by the page table.
+//
+// Ranges are added with add() during elaboration, then build() must be
+// called before the first call to find().
+class addr_decoder {
+public:
+	struct range {
+		addr_t begin;
+		addr_t end; // inclusive
+		int port;
+	};
+
+	static const unsigned int page_bits = 16;
+
+	addr_decoder();
+
+	// Add the range [begin, end] for the given port. Returns the port
+	// of an already added range overlapping [begin, end] (the range is
+	// not added in this case), or -1.
+	int add(addr_t begin, addr_t end, int port);
+
+	void build();
+
+	// Return the range containing a, or NULL when a is not mapped.
+	const range *find(addr_t a) const {
+		const range &r = ranges[pages[a >> page_bits]];
+		if (r.begin <= a && a <= r.end)
+			return &r;
+		return find_slow(a, pages[a >> page_bits]);
+	}
+
+	typedef std::vector<range>::const_iterator const_iterator;
+
+	// Iterate through the ranges, sorted by address.
+	const_iterator begin() const {
+		return ranges.begin();
+	}
+	const_iterator end() const {
+		return ranges.end() - 1;
+	}
+
+private:
+	const range *find_slow(addr_t a, unsigned int first) const;
+
+	// Sorted ranges, followed by a sentinel matching no address.
+	std::vector<range> ranges;
+	std::vector<unsigned int> pages;
+};
+}
+
+#endif
@@ -1,31 +1,67 @@
 #include "ensitlm.h"
 #include "bus.h"
 
+#include <algorithm>
+
 using namespace std;
 
-Bus::Bus(sc_core::sc_module_name name) : sc_core::sc_module(name) {
+template <unsigned int BUSWIDTH>
+BasicBus<BUSWIDTH>::BasicBus(sc_core::sc_module_name name)
+    : sc_core::sc_module(name), trace(NULL),
+      cycle(sc_core::SC_ZERO_TIME), cycles_per_beat(1), policy(round_robin),
+      busy(false), owner(-1), granted(-1), posted(0), posted_addr(0),
+      posted_range(NULL), posted_from(-1) {
 	cout << name << ": Ensitlm bus" << endl;
 }
 
-void Bus::map(ensitlm::compatible_socket &port, ensitlm::addr_t start_addr,
-              ensitlm::addr_t size) {
-	port_map.insert(std::pair<ensitlm::compatible_socket *, addr_range>(
-	    &port, addr_range(start_addr, start_addr + size - 1)));
+template <unsigned int BUSWIDTH> BasicBus<BUSWIDTH>::~BasicBus() {
+	delete trace;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::record_to(const char *file) {
+	trace_file = file;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::map(compatible_socket &port,
+                             ensitlm::addr_t start_addr, ensitlm::addr_t size,
+                             bool bufferable) {
+	port_map.insert(std::pair<compatible_socket *, addr_range>(
+	    &port, addr_range(start_addr, start_addr + size - 1, bufferable)));
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::set_timing(const sc_core::sc_time &cycle,
+                                    unsigned int cycles_per_beat,
+                                    arbitration policy) {
+	this->cycle = cycle;
+	this->cycles_per_beat = cycles_per_beat;
+	this->policy = policy;
 }
 
-void Bus::end_of_elaboration() {
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::set_wait_states(compatible_socket &port,
+                                         unsigned int cycles) {
+	wait_state_map[&port] = cycles;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::end_of_elaboration() {
+	bufferable.assign(initiator.size(), false);
 	// for each target connected to this bus initiator port
 	for (int i = 0; i < initiator.size(); ++i) {
 		// get the target
-		ensitlm::compatible_socket *target =
-		    dynamic_cast<ensitlm::compatible_socket *>(initiator[i]);
+		compatible_socket *target =
+		    dynamic_cast<compatible_socket *>(initiator[i]);
 		if (!target) {
 			std::cerr << name()
 			          << ": target is not a tlm_target_socket\n";
 			abort();
 		}
 		// get the set of port maps which correspond to this name
-		std::pair<port_map_t::iterator, port_map_t::iterator> it =
+		std::pair<typename port_map_t::iterator,
+	          typename port_map_t::iterator> it =
 		    port_map.equal_range(target);
 		// if no port map corresponds
 		if (it.first == it.second) {
@@ -35,15 +71,14 @@ void Bus::end_of_elaboration() {
 			abort();
 		}
 		// iterate through port maps
-		for (port_map_t::iterator j = it.first; j != it.second; ++j) {
-			std::pair<addr_range, int> map_entry((*j).second, i);
+		for (typename port_map_t::iterator j = it.first;
+		     j != it.second; ++j) {
 			// add to address map and check for conflicts
-			if (!addr_map.insert(map_entry).second) {
-				std::pair<addr_range, int> map_entry_bis =
-				    (*addr_map.find((*j).second));
-				int k = map_entry_bis.second;
-				ensitlm::compatible_socket *target_bis =
-				    dynamic_cast<ensitlm::compatible_socket *>(
+			int k = addr_map.add((*j).second.begin,
+			                     (*j).second.end, i);
+			if (k >= 0) {
+				compatible_socket *target_bis =
+				    dynamic_cast<compatible_socket *>(
 				        initiator[k]);
 				std::cerr << name() << ": address map conflict "
 				                       "between target ports "
@@ -51,42 +86,244 @@ void Bus::end_of_elaboration() {
 				          << target_bis->name() << "\n";
 				abort();
 			}
+			if ((*j).second.bufferable)
+				bufferable[i] = true;
 		}
 	}
+	addr_map.build();
 	//   #ifdef DEBUG
 	print_addr_map();
 	//   #endif
+
+	wait_states.assign(initiator.size(), 0);
+	for (int i = 0; i < initiator.size(); ++i) {
+		typename std::map<compatible_socket *,
+		                  unsigned int>::const_iterator it =
+		    wait_state_map.find(
+		        dynamic_cast<compatible_socket *>(initiator[i]));
+		if (it != wait_state_map.end())
+			wait_states[i] = (*it).second;
+	}
+	requests.assign(target.size() + 1, 0);
+	contention_stats.assign(target.size() + 1, contention());
+
+	if (!trace_file.empty()) {
+		std::vector<std::string> initiators, targets;
+		for (int i = 0; i < target.size(); ++i)
+			initiators.push_back(ensitlm::recorder::name_of(
+			    target[i], "initiator", i));
+		for (int i = 0; i < initiator.size(); ++i)
+			targets.push_back(ensitlm::recorder::name_of(
+			    initiator[i], "target", i));
+		trace = new ensitlm::recorder(trace_file.c_str(), initiators,
+		                              targets);
+	}
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::end_of_simulation() {
+	// The last posted writes reach the target now, without time (we
+	// cannot wait for the bus here).
+	if (posted) {
+		sc_core::sc_time t = sc_core::SC_ZERO_TIME;
+		tlm::tlm_response_status s = initiator.write_block(
+		    posted_addr - posted_range->begin, posted_data, posted, t,
+		    posted_range->port);
+		record(t, posted_from, posted_addr, posted_range,
+		       posted_data[0], tlm::TLM_WRITE_COMMAND,
+		       posted * sizeof(data_t), s);
+		posted = 0;
+	}
+
+	// Flush the trace now, the simulation may never be destroyed.
+	delete trace;
+	trace = NULL;
+
+	if (!timed())
+		return;
+	sc_core::sc_time now = sc_core::sc_time_stamp();
+	std::cout << name() << ": contention per initiator" << std::endl;
+	for (size_t i = 0; i < contention_stats.size(); ++i) {
+		const contention &c = contention_stats[i];
+		if (!c.accesses)
+			continue;
+		std::cout << "  "
+		          << (int(i) < target.size()
+		                  ? ensitlm::recorder::name_of(target[i],
+		                                               "initiator", i)
+		                  : std::string("unknown initiators"))
+		          << ": " << std::dec << c.accesses
+		          << " accesses, busy " << c.busy;
+		if (now != sc_core::SC_ZERO_TIME)
+			std::cout << " (" << 100 * (c.busy / now) << "%)";
+		std::cout << ", stalled " << c.stall << " (max " << c.max_stall
+		          << ")" << std::endl;
+	}
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::post(int from, ensitlm::addr_t a,
+                              const ensitlm::addr_decoder::range *range,
+                              data_t d, sc_core::sc_time &t) {
+	if (posted && (range != posted_range || from != posted_from ||
+	               posted == posted_max ||
+	               a != posted_addr + posted * sizeof(data_t)))
+		drain(t);
+	if (!posted) {
+		posted_addr = a;
+		posted_range = range;
+		posted_from = from;
+	}
+	posted_data[posted++] = d;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::drain(sc_core::sc_time &t) {
+	// Other initiators may post new writes while we wait for the bus
+	// (with the contention model): empty the buffer first.
+	data_t data[posted_max];
+	std::copy(posted_data, posted_data + posted, data);
+	unsigned int n = posted;
+	ensitlm::addr_t a = posted_addr;
+	const ensitlm::addr_decoder::range *range = posted_range;
+	posted = 0;
+
+	tlm::tlm_response_status s =
+	    forward_write_block(posted_from, a, range, data, n, t);
+	if (s != tlm::TLM_OK_RESPONSE)
+		std::cerr << name() << ": posted write error at " << std::hex
+		          << a << std::endl;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::read_posted(ensitlm::addr_t a, unsigned char *buf,
+                                     unsigned int length) {
+	const unsigned char *bytes =
+	    reinterpret_cast<const unsigned char *>(posted_data);
+	sc_dt::uint64 end =
+	    posted_addr + sc_dt::uint64(posted) * sizeof(data_t);
+	for (sc_dt::uint64 i = std::max<sc_dt::uint64>(a, posted_addr);
+	     i < std::min(sc_dt::uint64(a) + length, end); ++i)
+		buf[i - a] = bytes[i - posted_addr];
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::write_posted(ensitlm::addr_t a,
+                                      const unsigned char *buf,
+                                      unsigned int length) {
+	unsigned char *bytes = reinterpret_cast<unsigned char *>(posted_data);
+	sc_dt::uint64 end =
+	    posted_addr + sc_dt::uint64(posted) * sizeof(data_t);
+	for (sc_dt::uint64 i = std::max<sc_dt::uint64>(a, posted_addr);
+	     i < std::min(sc_dt::uint64(a) + length, end); ++i)
+		bytes[i - posted_addr] = buf[i - a];
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::begin_access(sc_core::sc_time &t, int from) {
+	if (t != sc_core::SC_ZERO_TIME) {
+		sc_core::wait(t);
+		t = sc_core::SC_ZERO_TIME;
+	}
+	int i = slot(from);
+	sc_core::sc_time requested = sc_core::sc_time_stamp();
+	if (busy) {
+		++requests[i];
+		while (granted != i)
+			sc_core::wait(grant_event);
+		granted = -1;
+	}
+	busy = true;
+	owner = i;
+
+	contention &c = contention_stats[i];
+	sc_core::sc_time stall = sc_core::sc_time_stamp() - requested;
+	++c.accesses;
+	c.stall += stall;
+	if (stall > c.max_stall)
+		c.max_stall = stall;
 }
 
-void Bus::print_addr_map() {
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::end_access(sc_core::sc_time &t, int from,
+                                    unsigned int beats, int port) {
+	sc_core::sc_time hold =
+	    cycle * double(beats * cycles_per_beat + wait_states[port]) + t;
+	if (hold != sc_core::SC_ZERO_TIME)
+		sc_core::wait(hold);
+	t = sc_core::SC_ZERO_TIME;
+	contention_stats[slot(from)].busy += hold;
+
+	// Give the bus to the next initiator waiting for it, if any.
+	int n = requests.size();
+	for (int k = 0; k < n; ++k) {
+		int j = policy == fixed_priority ? k : (owner + 1 + k) % n;
+		if (requests[j]) {
+			--requests[j];
+			owner = granted = j;
+			grant_event.notify(sc_core::SC_ZERO_TIME);
+			return;
+		}
+	}
+	busy = false;
+	owner = -1;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::print_addr_map() {
 	// iterate through port maps
-	for (addr_map_t::iterator i = addr_map.begin(); i != addr_map.end();
-	     ++i) {
-		std::cout << name() << ": range [" << std::hex
-		          << (*i).first.begin << "-" << (*i).first.end + 1
-		          << "[ is mapped to target '"
-		          << dynamic_cast<ensitlm::compatible_socket *>(
-		                 initiator[((*i).second)])->name() << "'\n";
+	for (ensitlm::addr_decoder::const_iterator i = addr_map.begin();
+	     i != addr_map.end(); ++i) {
+		std::cout << name() << ": range [" << std::hex << (*i).begin
+		          << "-" << (*i).end + 1 << "[ is mapped to target '"
+		          << dynamic_cast<compatible_socket *>(
+		                 initiator[(*i).port])->name() << "'\n";
 	}
 }
 
-tlm::tlm_response_status Bus::read(ensitlm::addr_t a, ensitlm::data_t &d) {
-	if (a % sizeof(ensitlm::data_t)) {
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicBus<BUSWIDTH>::read(ensitlm::addr_t a,
+                                                  data_t &d) {
+	sc_core::sc_time t = sc_core::SC_ZERO_TIME;
+	return read(a, d, t);
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicBus<BUSWIDTH>::write(ensitlm::addr_t a,
+                                                   data_t d) {
+	sc_core::sc_time t = sc_core::SC_ZERO_TIME;
+	return write(a, d, t);
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicBus<BUSWIDTH>::read(ensitlm::addr_t a, data_t &d,
+                                                  sc_core::sc_time &t) {
+	int from = target.initiator();
+	if (a % sizeof(data_t)) {
 		std::stringstream s;
 		s << "unaligned read at 0x" << std::hex << a;
 		SC_REPORT_ERROR(name(), s.str().c_str());
 		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
 	}
 
-	addr_map_t::iterator it = addr_map.find(addr_range(a, a));
-	if (it == addr_map.end()) {
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!range) {
 		std::cerr << name() << ": no target at address " << std::hex
 		          << a << std::endl;
+		record(t, from, a, NULL, 0, tlm::TLM_READ_COMMAND,
+		       sizeof(data_t), tlm::TLM_ADDRESS_ERROR_RESPONSE);
 		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
 	}
 
+	drain_before(range, t);
+	if (timed())
+		begin_access(t, from);
 	tlm::tlm_response_status s =
-	    initiator.read(a - (*it).first.begin, d, (*it).second);
+	    initiator.read(a - range->begin, d, t, range->port);
+	if (timed())
+		end_access(t, from, 1, range->port);
+	record(t, from, a, range, d, tlm::TLM_READ_COMMAND, sizeof(data_t),
+	       s);
 
 #ifdef DEBUG
 	std::cout << "Debug: " << name() << ": read access at " << std::hex
@@ -96,18 +333,23 @@ tlm::tlm_response_status Bus::read(ensitlm::addr_t a, ensitlm::data_t &d) {
 	return s;
 }
 
-tlm::tlm_response_status Bus::write(ensitlm::addr_t a, ensitlm::data_t d) {
-	if (a % sizeof(ensitlm::data_t)) {
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicBus<BUSWIDTH>::write(ensitlm::addr_t a, data_t d,
+                                                   sc_core::sc_time &t) {
+	int from = target.initiator();
+	if (a % sizeof(data_t)) {
 		std::stringstream s;
 		s << "unaligned write at 0x" << std::hex << a;
 		SC_REPORT_ERROR(name(), s.str().c_str());
 		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
 	}
 
-	addr_map_t::iterator it = addr_map.find(addr_range(a, a));
-	if (it == addr_map.end()) {
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!range) {
 		std::cerr << name() << ": no target at address " << std::hex
 		          << a << std::endl;
+		record(t, from, a, NULL, d, tlm::TLM_WRITE_COMMAND,
+		       sizeof(data_t), tlm::TLM_ADDRESS_ERROR_RESPONSE);
 		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
 	}
 
@@ -116,8 +358,250 @@ tlm::tlm_response_status Bus::write(ensitlm::addr_t a, ensitlm::data_t d) {
 	          << std::showbase << a << " (data: " << d << ")\n";
 #endif
 
+	if (bufferable[range->port]) {
+		post(from, a, range, d, t);
+		return tlm::TLM_OK_RESPONSE;
+	}
+
+	drain_before(range, t);
+	if (timed())
+		begin_access(t, from);
 	tlm::tlm_response_status s =
-	    initiator.write(a - (*it).first.begin, d, (*it).second);
+	    initiator.write(a - range->begin, d, t, range->port);
+	if (timed())
+		end_access(t, from, 1, range->port);
+	record(t, from, a, range, d, tlm::TLM_WRITE_COMMAND, sizeof(data_t),
+	       s);
 
 	return s;
 }
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicBus<BUSWIDTH>::write_masked(ensitlm::addr_t a,
+                                                          data_t d,
+                                                          unsigned int be,
+                                                          sc_core::sc_time &t) {
+	int from = target.initiator();
+	if (a % sizeof(data_t)) {
+		std::stringstream s;
+		s << "unaligned write at 0x" << std::hex << a;
+		SC_REPORT_ERROR(name(), s.str().c_str());
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!range) {
+		std::cerr << name() << ": no target at address " << std::hex
+		          << a << std::endl;
+		record(t, from, a, NULL, d, tlm::TLM_WRITE_COMMAND,
+		       __builtin_popcount(be), tlm::TLM_ADDRESS_ERROR_RESPONSE);
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+
+#ifdef DEBUG
+	std::cout << "Debug: " << name() << ": write access at " << std::hex
+	          << std::showbase << a << " (data: " << d
+	          << ", byte enables: " << be << ")\n";
+#endif
+
+	drain_before(range, t);
+	if (timed())
+		begin_access(t, from);
+	tlm::tlm_response_status s =
+	    initiator.write_masked(a - range->begin, d, be, t, range->port);
+	if (timed())
+		end_access(t, from, 1, range->port);
+	record(t, from, a, range, d, tlm::TLM_WRITE_COMMAND,
+	       __builtin_popcount(be), s);
+	return s;
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicBus<BUSWIDTH>::read_block(ensitlm::addr_t a,
+                                                        data_t *d,
+                                                        unsigned int n,
+                                                        sc_core::sc_time &t) {
+	int from = target.initiator();
+	if (a % sizeof(data_t)) {
+		std::stringstream s;
+		s << "unaligned block read at 0x" << std::hex << a;
+		SC_REPORT_ERROR(name(), s.str().c_str());
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+
+	// The whole block must be mapped to the same target.
+	ensitlm::addr_t last = a + n * sizeof(data_t) - 1;
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!range || last < a || last > range->end) {
+		std::cerr << name() << ": no target for block at address "
+		          << std::hex << a << std::endl;
+		record(t, from, a, NULL, 0, tlm::TLM_READ_COMMAND,
+		       n * sizeof(data_t), tlm::TLM_ADDRESS_ERROR_RESPONSE);
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+
+	drain_before(range, t);
+	if (timed())
+		begin_access(t, from);
+	tlm::tlm_response_status s =
+	    initiator.read_block(a - range->begin, d, n, t, range->port);
+	if (timed())
+		end_access(t, from, n, range->port);
+	record(t, from, a, range, n ? d[0] : 0, tlm::TLM_READ_COMMAND,
+	       n * sizeof(data_t), s);
+
+#ifdef DEBUG
+	std::cout << "Debug: " << name() << ": block read access at "
+	          << std::hex << std::showbase << a << " (" << std::dec << n
+	          << " words)\n";
+#endif
+
+	return s;
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicBus<BUSWIDTH>::write_block(ensitlm::addr_t a,
+                                                         const data_t *d,
+                                                         unsigned int n,
+                                                         sc_core::sc_time &t) {
+	int from = target.initiator();
+	if (a % sizeof(data_t)) {
+		std::stringstream s;
+		s << "unaligned block write at 0x" << std::hex << a;
+		SC_REPORT_ERROR(name(), s.str().c_str());
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+
+	ensitlm::addr_t last = a + n * sizeof(data_t) - 1;
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!range || last < a || last > range->end) {
+		std::cerr << name() << ": no target for block at address "
+		          << std::hex << a << std::endl;
+		record(t, from, a, NULL, n ? d[0] : 0, tlm::TLM_WRITE_COMMAND,
+		       n * sizeof(data_t), tlm::TLM_ADDRESS_ERROR_RESPONSE);
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+
+#ifdef DEBUG
+	std::cout << "Debug: " << name() << ": block write access at "
+	          << std::hex << std::showbase << a << " (" << std::dec << n
+	          << " words)\n";
+#endif
+
+	drain_before(range, t);
+	return forward_write_block(from, a, range, d, n, t);
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicBus<BUSWIDTH>::forward_write_block(
+    int from, ensitlm::addr_t a, const ensitlm::addr_decoder::range *range,
+    const data_t *d, unsigned int n, sc_core::sc_time &t) {
+	if (timed())
+		begin_access(t, from);
+	tlm::tlm_response_status s =
+	    initiator.write_block(a - range->begin, d, n, t, range->port);
+	if (timed())
+		end_access(t, from, n, range->port);
+	record(t, from, a, range, n ? d[0] : 0, tlm::TLM_WRITE_COMMAND,
+	       n * sizeof(data_t), s);
+	return s;
+}
+
+template <unsigned int BUSWIDTH>
+unsigned int BasicBus<BUSWIDTH>::debug_read(ensitlm::addr_t a,
+                                            unsigned char *buf,
+                                            unsigned int length) {
+	ensitlm::addr_t start = a;
+	unsigned int done = 0;
+	while (done < length) {
+		const ensitlm::addr_decoder::range *range = addr_map.find(a);
+		if (!range)
+			break;
+		// Stop at the end of the range, the rest goes to the next
+		// target.
+		unsigned int n = std::min<sc_dt::uint64>(
+		    length - done, sc_dt::uint64(range->end) - a + 1);
+		unsigned int r = initiator.debug_read(a - range->begin,
+		                                      buf + done, n, range->port);
+		done += r;
+		if (r < n)
+			break;
+		a += n;
+	}
+	read_posted(start, buf, done);
+	return done;
+}
+
+template <unsigned int BUSWIDTH>
+unsigned int BasicBus<BUSWIDTH>::debug_write(ensitlm::addr_t a,
+                                             const unsigned char *buf,
+                                             unsigned int length) {
+	write_posted(a, buf, length);
+	unsigned int done = 0;
+	while (done < length) {
+		const ensitlm::addr_decoder::range *range = addr_map.find(a);
+		if (!range)
+			break;
+		unsigned int n = std::min<sc_dt::uint64>(
+		    length - done, sc_dt::uint64(range->end) - a + 1);
+		unsigned int r = initiator.debug_write(
+		    a - range->begin, buf + done, n, range->port);
+		done += r;
+		if (r < n)
+			break;
+		a += n;
+	}
+	return done;
+}
+
+template <unsigned int BUSWIDTH>
+bool BasicBus<BUSWIDTH>::get_direct_mem_ptr(ensitlm::addr_t a,
+                                            tlm::tlm_dmi &dmi) {
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (range && (!trace_file.empty() || timed() ||
+	              bufferable[range->port])) {
+		// Recording, modeling contention or posting writes: refused
+		// for the whole range, the initiators will not ask again.
+		dmi.allow_none();
+		dmi.set_start_address(range->begin);
+		dmi.set_end_address(range->end);
+		return false;
+	}
+	if (!range) {
+		// Nothing to access here, directly or not.
+		dmi.set_start_address(a);
+		dmi.set_end_address(a);
+		return false;
+	}
+
+	// Granted or not, the answer is for a region of the target, to be
+	// translated and clipped to the range it is mapped to.
+	bool granted =
+	    initiator.get_direct_mem_ptr(a - range->begin, dmi, range->port);
+	sc_dt::uint64 size = sc_dt::uint64(range->end) - range->begin;
+	dmi.set_start_address(range->begin + dmi.get_start_address());
+	if (dmi.get_end_address() > size)
+		dmi.set_end_address(range->end);
+	else
+		dmi.set_end_address(range->begin + dmi.get_end_address());
+	return granted;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicBus<BUSWIDTH>::invalidate_direct_mem_ptr(sc_dt::uint64 start,
+                                                   sc_dt::uint64 end) {
+	// We do not know which target sent the invalidation: translate it
+	// for every range, the initiators will only drop the regions they
+	// actually have.
+	for (ensitlm::addr_decoder::const_iterator i = addr_map.begin();
+	     i != addr_map.end(); ++i) {
+		sc_dt::uint64 size = sc_dt::uint64((*i).end) - (*i).begin;
+		if (start > size)
+			continue;
+		target.invalidate_direct_mem_ptr(
+		    (*i).begin + start, (*i).begin + std::min(end, size));
+	}
+}
+
+template struct BasicBus<32>;
+template struct BasicBus<64>;
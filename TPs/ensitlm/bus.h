@@ -2,46 +2,229 @@
 #define BUS_H
 
 #include "ensitlm.h"
+#include "addr_decoder.h"
+#include "recorder.h"
 
 #include <map>
+#include <string>
+#include <vector>
+
+// Bus BUSWIDTH bits wide: targets and initiators bound to it must have
+// the same width. The methods are defined in bus.cpp, for 32 and 64-bit
+// buses.
+template <unsigned int BUSWIDTH = 32> struct BasicBus : sc_core::sc_module {
+	typedef typename ensitlm::bus_data<BUSWIDTH>::type data_t;
+	typedef ensitlm::basic_compatible_socket<BUSWIDTH> compatible_socket;
 
-SC_MODULE(Bus) {
 	// The bus is the only component needing this "true" template
 	// parameter, to allow multi-port connections.
-	ensitlm::initiator_socket<Bus, true> initiator;
-	ensitlm::target_socket<Bus, true> target;
+	ensitlm::initiator_socket<BasicBus, true, BUSWIDTH> initiator;
+	ensitlm::target_socket<BasicBus, true, BUSWIDTH> target;
+
+	BasicBus(sc_core::sc_module_name name);
+	~BasicBus();
+
+	tlm::tlm_response_status read(ensitlm::addr_t a, data_t & d);
+
+	tlm::tlm_response_status write(ensitlm::addr_t a, data_t d);
+
+	// The timed versions forward the local time offset of the
+	// initiator to the target, which adds the access latency to it.
+	tlm::tlm_response_status read(ensitlm::addr_t a, data_t & d,
+	                              sc_core::sc_time & t);
+
+	tlm::tlm_response_status write(ensitlm::addr_t a, data_t d,
+	                               sc_core::sc_time & t);
+
+	// Partial writes are forwarded as such to the target.
+	tlm::tlm_response_status write_masked(ensitlm::addr_t a,
+	                                      data_t d,
+	                                      unsigned int be,
+	                                      sc_core::sc_time &t);
+
+	tlm::tlm_response_status read_block(ensitlm::addr_t a,
+	                                    data_t * d, unsigned int n,
+	                                    sc_core::sc_time & t);
 
-	Bus(sc_core::sc_module_name name);
+	tlm::tlm_response_status write_block(ensitlm::addr_t a,
+	                                     const data_t *d,
+	                                     unsigned int n,
+	                                     sc_core::sc_time &t);
 
-	tlm::tlm_response_status read(ensitlm::addr_t a, ensitlm::data_t & d);
+	// Debug accesses may span several targets.
+	unsigned int debug_read(ensitlm::addr_t a, unsigned char *buf,
+	                        unsigned int length);
 
-	tlm::tlm_response_status write(ensitlm::addr_t a, ensitlm::data_t d);
+	unsigned int debug_write(ensitlm::addr_t a, const unsigned char *buf,
+	                         unsigned int length);
 
-	void map(ensitlm::compatible_socket & port, ensitlm::addr_t start_addr,
-	         ensitlm::addr_t size);
+	// DMI requests are forwarded to the target, and the region it
+	// returns is translated back to the bus address space.
+	bool get_direct_mem_ptr(ensitlm::addr_t a, tlm::tlm_dmi & dmi);
+
+	// Called by the initiator socket when a target invalidates DMI
+	// pointers: forwarded to the initiators of the bus.
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end);
+
+	// A bufferable target accepts posted writes: single-word writes to
+	// it are acknowledged at once, without time, and kept in a buffer
+	// which merges contiguous ones into a block write. The buffer is
+	// written to the target (drained) before any other access to the
+	// same target, so that the target sees its accesses in order even
+	// when a read of one register depends on a write to another, when
+	// a write does not continue it, and at the end of the simulation;
+	// errors of the posted writes are only printed. The bus refuses DMI
+	// to bufferable targets, as the initiators would bypass the buffer.
+	void map(compatible_socket & port, ensitlm::addr_t start_addr,
+	         ensitlm::addr_t size, bool bufferable = false);
+
+	// Record every access (debug ones excepted) into a binary trace
+	// (see recorder.h), to be called before the simulation starts. DMI
+	// is then refused to the initiators, so that all their accesses go
+	// through the bus.
+	void record_to(const char *file);
+
+	// Contention model, disabled by default: the bus then takes no
+	// time, and several initiators may use it at once.
+	//
+	// Once enabled by set_timing(), the bus is used by one initiator at
+	// a time. An initiator first synchronizes with the kernel, then
+	// waits until the bus is granted to it; the bus is then held for
+	// cycles_per_beat cycles per data_t transferred, plus the wait
+	// states of the target, plus the time the target added. Waiting
+	// initiators are granted the bus in turn (round_robin), or the
+	// first bound first (fixed_priority). The accesses must then come
+	// from threads, DMI is refused, and the stall time and utilisation
+	// of each initiator are printed at the end of the simulation.
+	enum arbitration { round_robin, fixed_priority };
+
+	void set_timing(const sc_core::sc_time &cycle,
+	                unsigned int cycles_per_beat = 1,
+	                arbitration policy = round_robin);
+
+	// Cycles added to every access to port.
+	void set_wait_states(compatible_socket & port, unsigned int cycles);
 
 private:
 	void print_addr_map();
 	void end_of_elaboration();
+	void end_of_simulation();
+
+	std::string trace_file;
+	ensitlm::recorder *trace;
+
+	bool timed() const {
+		return cycle != sc_core::SC_ZERO_TIME;
+	}
+
+	// Contention model: wait for the bus, then hold it for the access
+	// of beats data_t to target port, which took t.
+	void begin_access(sc_core::sc_time & t, int from);
+	void end_access(sc_core::sc_time & t, int from, unsigned int beats,
+	                int port);
+
+	// Initiator index for the contention model, unknown ones last.
+	int slot(int from) const {
+		return from < 0 ? target.size() : from;
+	}
+
+	sc_core::sc_time cycle;
+	unsigned int cycles_per_beat;
+	arbitration policy;
+	std::map<compatible_socket *, unsigned int> wait_state_map;
+	// Per target port, built at the end of elaboration.
+	std::vector<unsigned int> wait_states;
+
+	// Arbitration: owner holds the bus (or held it last), granted is
+	// the initiator the bus was just given to, until it notices, and
+	// requests counts the waiting accesses of each initiator.
+	bool busy;
+	int owner;
+	int granted;
+	std::vector<unsigned int> requests;
+	sc_core::sc_event grant_event;
+
+	struct contention {
+		contention() : accesses(0) {
+		}
+		uint64_t accesses;
+		sc_core::sc_time busy;
+		sc_core::sc_time stall;
+		sc_core::sc_time max_stall;
+	};
+	std::vector<contention> contention_stats;
+
+	// Posted writes: posted words written by initiator posted_from
+	// from bus address posted_addr on, in range posted_range.
+	static const unsigned int posted_max = 64;
+	// Per target port, built at the end of elaboration.
+	std::vector<bool> bufferable;
+	data_t posted_data[posted_max];
+	unsigned int posted;
+	ensitlm::addr_t posted_addr;
+	const ensitlm::addr_decoder::range *posted_range;
+	int posted_from;
+
+	void post(int from, ensitlm::addr_t a,
+	          const ensitlm::addr_decoder::range *range, data_t d,
+	          sc_core::sc_time &t);
+	void drain(sc_core::sc_time & t);
+
+	// Drain the buffer before an access to the target of range.
+	void drain_before(const ensitlm::addr_decoder::range *range,
+	                  sc_core::sc_time &t) {
+		if (posted && range->port == posted_range->port)
+			drain(t);
+	}
+
+	// Debug accesses see the posted writes: debug reads get the bytes
+	// of the buffer overlapping them, debug writes update them.
+	void read_posted(ensitlm::addr_t a, unsigned char *buf,
+	                 unsigned int length);
+	void write_posted(ensitlm::addr_t a, const unsigned char *buf,
+	                  unsigned int length);
+
+	tlm::tlm_response_status
+	forward_write_block(int from, ensitlm::addr_t a,
+	                    const ensitlm::addr_decoder::range *range,
+	                    const data_t *d, unsigned int n,
+	                    sc_core::sc_time &t);
+
+	// from is the initiator (target.initiator() when the access
+	// began), range is NULL for addresses not mapped to any target.
+	void record(const sc_core::sc_time &t, int from, ensitlm::addr_t a,
+	            const ensitlm::addr_decoder::range *range, uint64_t d,
+	            tlm::tlm_command command, unsigned int length,
+	            tlm::tlm_response_status s) {
+		if (trace)
+			trace->record(t, from, range ? range->port : -1, a, d,
+			              command, length, s);
+	}
 
 	class addr_range {
 	public:
-		addr_range(ensitlm::addr_t b, ensitlm::addr_t e)
-		    : begin(b), end(e) {
+		addr_range(ensitlm::addr_t b, ensitlm::addr_t e,
+		           bool buf = false)
+		    : begin(b), end(e), bufferable(buf) {
 		}
 		const ensitlm::addr_t begin;
 		const ensitlm::addr_t end;
+		const bool bufferable;
 		bool operator<(const addr_range &ar) const {
 			return (end < ar.begin);
 		}
 	};
 
-	typedef std::multimap<ensitlm::compatible_socket *, addr_range>
-	    port_map_t;
+	typedef std::multimap<compatible_socket *, addr_range> port_map_t;
 	port_map_t port_map;
 
-	typedef std::map<addr_range, int> addr_map_t;
-	addr_map_t addr_map;
+	// Built from port_map at the end of elaboration.
+	ensitlm::addr_decoder addr_map;
 };
 
+extern template struct BasicBus<32>;
+extern template struct BasicBus<64>;
+
+typedef BasicBus<> Bus;
+
 #endif
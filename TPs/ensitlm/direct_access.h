@@ -0,0 +1,87 @@
+#ifndef ENSITLM_DIRECT_ACCESS_H
+#define ENSITLM_DIRECT_ACCESS_H
+
+#include "ensitlm.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace ensitlm {
+
+// Entry points of an ensitlm target socket, called directly by the
+// ensitlm initiator sockets bound to it instead of building a generic
+// payload and calling b_transport. They are resolved by the initiator
+// sockets at the end of elaboration.
+//
+// Setting the environment variable ENSITLM_FORCE_TLM (to anything but
+// 0) disables them: every access then goes through the standard TLM
+// interfaces, as with any non-ensitlm target.
+//
+// DATA is the data type of the bus (see bus_data).
+template <typename DATA = data_t> struct basic_direct_access {
+	basic_direct_access()
+	    : target(NULL), read(NULL), write(NULL), write_masked(NULL),
+	      dmi_hint(false) {
+	}
+
+	// Argument given to the functions below (the target socket, or
+	// for multiport target sockets, the entry of the initiator).
+	void *target;
+
+	tlm::tlm_response_status (*read)(void *target, addr_t a, DATA &d,
+	                                 sc_core::sc_time &t);
+	tlm::tlm_response_status (*write)(void *target, addr_t a, DATA d,
+	                                  sc_core::sc_time &t);
+	tlm::tlm_response_status (*write_masked)(void *target, addr_t a,
+	                                         DATA d, unsigned int be,
+	                                         sc_core::sc_time &t);
+
+	// The target may grant DMI: the initiator asks for it after a
+	// successful access, as it does when b_transport sets the DMI
+	// hint.
+	bool dmi_hint;
+};
+
+typedef basic_direct_access<> direct_access;
+
+// Implemented by the target sockets providing direct accesses.
+// initiator is the backward interface of the initiator socket asking,
+// which tells the multiport target sockets which initiator is calling.
+template <typename DATA = data_t> class basic_direct_target {
+public:
+	virtual ~basic_direct_target() {
+	}
+
+	virtual void
+	get_direct_access(basic_direct_access<DATA> &access,
+	                  const tlm::tlm_bw_transport_if<> *initiator) = 0;
+};
+
+typedef basic_direct_target<> direct_target;
+
+// Attached by the ensitlm initiator sockets to their payloads (see
+// mm::extension()), so that multiport target sockets know which of
+// their initiators sent a transaction.
+struct origin : tlm::tlm_extension<origin> {
+	origin() : initiator(NULL) {
+	}
+
+	tlm::tlm_extension_base *clone() const {
+		return new origin(*this);
+	}
+
+	void copy_from(const tlm::tlm_extension_base &ext) {
+		initiator = static_cast<const origin &>(ext).initiator;
+	}
+
+	// Backward interface of the initiator socket.
+	const tlm::tlm_bw_transport_if<> *initiator;
+};
+
+inline bool force_tlm() {
+	const char *env = getenv("ENSITLM_FORCE_TLM");
+	return env && *env && strcmp(env, "0") != 0;
+}
+}
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef ENSITLM_H
 #define ENSITLM_H
 
+// The target sockets spawn a thread for the approximately-timed mode.
+#ifndef SC_INCLUDE_DYNAMIC_PROCESSES
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+#endif
 #include <systemc>
 #include <tlm.h>
 #include <stdint.h>
@@ -8,9 +12,21 @@
 
 namespace ensitlm {
 typedef uint32_t addr_t;
-typedef uint32_t data_t;
+
+// Data moved by one bus access, for a bus BUSWIDTH bits wide. The
+// sockets, Bus, FastBus and Memory take the width as a template
+// parameter, 32 by default.
+template <unsigned int BUSWIDTH> struct bus_data;
+template <> struct bus_data<32> { typedef uint32_t type; };
+template <> struct bus_data<64> { typedef uint64_t type; };
+
+typedef bus_data<32>::type data_t;
 }
 
+#include "hooks.h"
+#include "direct_access.h"
+#include "mm.h"
+#include "stats.h"
 #include "initiator_socket.h"
 #include "target_socket.h"
 
@@ -0,0 +1,259 @@
+#ifndef ENSITLM_HOOKS_H
+#define ENSITLM_HOOKS_H
+
+#include "ensitlm.h"
+
+#include <type_traits>
+#include <utility>
+
+// Compile-time detection of the optional methods a module may provide
+// on top of the mandatory read and write methods. Each trait below is
+// std::true_type when the corresponding call is well-formed on the
+// module, std::false_type otherwise.
+//
+// The sockets use these traits (as tags for overloading) to call the
+// optional method when it exists, and to fall back to a default
+// behavior otherwise. Sockets are members of their module, so the
+// traits must only be used in member function bodies, where MODULE is
+// a complete type.
+
+namespace ensitlm {
+namespace hooks {
+
+namespace probe {
+template <typename T>
+char get_direct_mem_ptr(decltype(std::declval<T &>().get_direct_mem_ptr(
+    std::declval<addr_t>(), std::declval<tlm::tlm_dmi &>())) *);
+template <typename T> long get_direct_mem_ptr(...);
+
+template <typename T>
+char invalidate_direct_mem_ptr(
+    decltype(std::declval<T &>().invalidate_direct_mem_ptr(
+        std::declval<sc_dt::uint64>(), std::declval<sc_dt::uint64>())) *);
+template <typename T> long invalidate_direct_mem_ptr(...);
+
+template <typename T, typename D>
+char read_block(decltype(std::declval<T &>().read_block(
+    std::declval<addr_t>(), std::declval<D *>(), 0u)) *);
+template <typename T, typename D> long read_block(...);
+
+template <typename T, typename D>
+char write_block(decltype(std::declval<T &>().write_block(
+    std::declval<addr_t>(), std::declval<const D *>(), 0u)) *);
+template <typename T, typename D> long write_block(...);
+
+template <typename T, typename D>
+char timed_read(decltype(std::declval<T &>().read(
+    std::declval<addr_t>(), std::declval<D &>(),
+    std::declval<sc_core::sc_time &>())) *);
+template <typename T, typename D> long timed_read(...);
+
+template <typename T, typename D>
+char timed_write(decltype(std::declval<T &>().write(
+    std::declval<addr_t>(), std::declval<D>(),
+    std::declval<sc_core::sc_time &>())) *);
+template <typename T, typename D> long timed_write(...);
+
+template <typename T, typename D>
+char timed_read_block(decltype(std::declval<T &>().read_block(
+    std::declval<addr_t>(), std::declval<D *>(), 0u,
+    std::declval<sc_core::sc_time &>())) *);
+template <typename T, typename D> long timed_read_block(...);
+
+template <typename T, typename D>
+char timed_write_block(decltype(std::declval<T &>().write_block(
+    std::declval<addr_t>(), std::declval<const D *>(), 0u,
+    std::declval<sc_core::sc_time &>())) *);
+template <typename T, typename D> long timed_write_block(...);
+
+template <typename T, typename D>
+char write_masked(decltype(std::declval<T &>().write_masked(
+    std::declval<addr_t>(), std::declval<D>(), 0u,
+    std::declval<sc_core::sc_time &>())) *);
+template <typename T, typename D> long write_masked(...);
+
+template <typename T>
+char debug_read(decltype(std::declval<T &>().debug_read(
+    std::declval<addr_t>(), std::declval<unsigned char *>(), 0u)) *);
+template <typename T> long debug_read(...);
+
+template <typename T>
+char debug_write(decltype(std::declval<T &>().debug_write(
+    std::declval<addr_t>(), std::declval<const unsigned char *>(), 0u)) *);
+template <typename T> long debug_write(...);
+}
+
+// bool get_direct_mem_ptr(addr_t a, tlm::tlm_dmi &dmi);
+//
+// Grant (return true) or refuse (return false) direct memory access
+// to the region containing a. Addresses in dmi are relative to the
+// module, like the ones received by read and write.
+template <typename MODULE>
+struct has_get_direct_mem_ptr
+    : std::integral_constant<bool, sizeof(probe::get_direct_mem_ptr<MODULE>(
+                                       0)) == sizeof(char)> {};
+
+// void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end);
+//
+// Initiator side: called by the initiator socket after it dropped its
+// own DMI regions overlapping [start, end], when a target invalidates
+// them. Interconnects use it to forward the invalidation to their own
+// initiators. Addresses are relative to the target, and the socket
+// cannot tell which of its ports the target is bound to.
+template <typename MODULE>
+struct has_invalidate_direct_mem_ptr
+    : std::integral_constant<bool,
+                             sizeof(probe::invalidate_direct_mem_ptr<MODULE>(
+                                 0)) == sizeof(char)> {};
+
+// tlm::tlm_response_status read(addr_t a, data_t &d, sc_core::sc_time &t);
+// tlm::tlm_response_status write(addr_t a, data_t d, sc_core::sc_time &t);
+//
+// Same as read and write, but the module may add the duration of the
+// access to t instead of calling wait(). When present, these are
+// called instead of the two-argument versions.
+template <typename MODULE, typename DATA = data_t>
+struct has_timed_read
+    : std::integral_constant<bool, sizeof(probe::timed_read<MODULE, DATA>(0)) ==
+                                       sizeof(char)> {};
+
+template <typename MODULE, typename DATA = data_t>
+struct has_timed_write
+    : std::integral_constant<bool, sizeof(probe::timed_write<MODULE, DATA>(0)) ==
+                                       sizeof(char)> {};
+
+// tlm::tlm_response_status read_block(addr_t a, data_t *d, unsigned int n);
+// tlm::tlm_response_status write_block(addr_t a, const data_t *d,
+//                                      unsigned int n);
+//
+// Transfer n consecutive data_t starting at a. Both may also take a
+// trailing sc_core::sc_time &t argument, like the timed read and write
+// (the timed version is preferred when both exist). Without these
+// methods, block transactions are split into n calls to read or write.
+template <typename MODULE, typename DATA = data_t>
+struct has_read_block
+    : std::integral_constant<bool, sizeof(probe::read_block<MODULE, DATA>(0)) ==
+                                       sizeof(char)> {};
+
+template <typename MODULE, typename DATA = data_t>
+struct has_write_block
+    : std::integral_constant<bool, sizeof(probe::write_block<MODULE, DATA>(0)) ==
+                                       sizeof(char)> {};
+
+template <typename MODULE, typename DATA = data_t>
+struct has_timed_read_block
+    : std::integral_constant<bool, sizeof(probe::timed_read_block<MODULE, DATA>(
+                                       0)) == sizeof(char)> {};
+
+template <typename MODULE, typename DATA = data_t>
+struct has_timed_write_block
+    : std::integral_constant<bool, sizeof(probe::timed_write_block<MODULE, DATA>(
+                                       0)) == sizeof(char)> {};
+
+// tlm::tlm_response_status write_masked(addr_t a, data_t d, unsigned int be,
+//                                       sc_core::sc_time &t);
+//
+// Write only the bytes of d enabled in be (bit i enables the byte at
+// address a + i, i.e. byte i of d in memory). Modules without this
+// method do not support partial writes, which then fail with
+// TLM_BYTE_ENABLE_ERROR_RESPONSE as in the TLM-2 base protocol: a
+// read-modify-write would read registers with side effects, and write
+// back the bytes that were not addressed.
+template <typename MODULE, typename DATA = data_t>
+struct has_write_masked
+    : std::integral_constant<bool, sizeof(probe::write_masked<MODULE, DATA>(0)) ==
+                                       sizeof(char)> {};
+
+// unsigned int debug_read(addr_t a, unsigned char *buf, unsigned int length);
+// unsigned int debug_write(addr_t a, const unsigned char *buf,
+//                          unsigned int length);
+//
+// Debug accesses (transport_dbg): copy up to length bytes at a, without
+// side effects and without consuming time, and return the number of
+// bytes actually copied. Modules without these methods do not support
+// debug accesses (0 bytes are copied).
+template <typename MODULE>
+struct has_debug_read
+    : std::integral_constant<bool, sizeof(probe::debug_read<MODULE>(0)) ==
+                                       sizeof(char)> {};
+
+template <typename MODULE>
+struct has_debug_write
+    : std::integral_constant<bool, sizeof(probe::debug_write<MODULE>(0)) ==
+                                       sizeof(char)> {};
+
+// Calls to the read and write methods of a module, using the optional
+// methods above when available. These are what the target sockets
+// call, and may be used by interconnects calling modules directly.
+// DATA is the data type of the bus (data_t for a 32-bit bus).
+namespace detail {
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_read(MODULE &m, addr_t a, DATA &d,
+                                   sc_core::sc_time &t, std::true_type) {
+	return m.read(a, d, t);
+}
+
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_read(MODULE &m, addr_t a, DATA &d,
+                                   sc_core::sc_time &, std::false_type) {
+	return m.read(a, d);
+}
+
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_write(MODULE &m, addr_t a, DATA d,
+                                    sc_core::sc_time &t, std::true_type) {
+	return m.write(a, d, t);
+}
+
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_write(MODULE &m, addr_t a, DATA d,
+                                    sc_core::sc_time &, std::false_type) {
+	return m.write(a, d);
+}
+
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_write_masked(MODULE &m, addr_t a, DATA d,
+                                           unsigned int be,
+                                           sc_core::sc_time &t,
+                                           std::true_type) {
+	return m.write_masked(a, d, be, t);
+}
+
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_write_masked(MODULE &, addr_t, DATA,
+                                           unsigned int, sc_core::sc_time &,
+                                           std::false_type) {
+	return tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE;
+}
+}
+
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_read(MODULE &m, addr_t a, DATA &d,
+                                   sc_core::sc_time &t) {
+	return detail::call_read(m, a, d, t, has_timed_read<MODULE, DATA>());
+}
+
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_write(MODULE &m, addr_t a, DATA d,
+                                    sc_core::sc_time &t) {
+	return detail::call_write(m, a, d, t, has_timed_write<MODULE, DATA>());
+}
+
+// Write the bytes of d enabled in be. Fails with
+// TLM_BYTE_ENABLE_ERROR_RESPONSE if the module has no write_masked
+// method.
+template <typename MODULE, typename DATA>
+tlm::tlm_response_status call_write_masked(MODULE &m, addr_t a, DATA d,
+                                           unsigned int be,
+                                           sc_core::sc_time &t) {
+	if (be == (1u << sizeof(DATA)) - 1)
+		return call_write(m, a, d, t);
+	if (be == 0)
+		return tlm::TLM_OK_RESPONSE;
+	return detail::call_write_masked(m, a, d, be, t,
+	                                 has_write_masked<MODULE, DATA>());
+}
+}
+}
+
+#endif
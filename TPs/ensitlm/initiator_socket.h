@@ -3,122 +3,786 @@
 
 #include "ensitlm.h"
 
+#include <tlm_utils/peq_with_get.h>
+#include <tlm_utils/tlm_quantumkeeper.h>
+
+#include <algorithm>
+#include <string.h>
 #include <vector>
 
 namespace ensitlm {
 
-template <typename MODULE, bool MULTIPORT = false>
+template <typename MODULE, bool MULTIPORT = false,
+          unsigned int BUSWIDTH = 32>
 class initiator_socket
-    : public tlm::tlm_initiator_socket<CHAR_BIT * sizeof(data_t),
+    : public tlm::tlm_initiator_socket<BUSWIDTH,
                                        tlm::tlm_base_protocol_types,
                                        MULTIPORT ? 0 : 1>,
-      private tlm::tlm_bw_transport_if<tlm::tlm_base_protocol_types> {
-	typedef tlm::tlm_initiator_socket<CHAR_BIT * sizeof(data_t),
+      public tlm::tlm_bw_transport_if<tlm::tlm_base_protocol_types> {
+	typedef tlm::tlm_initiator_socket<BUSWIDTH,
 	                                  tlm::tlm_base_protocol_types,
 	                                  MULTIPORT ? 0 : 1> base_type;
 	typedef tlm::tlm_bw_transport_if<tlm::tlm_base_protocol_types>
 	    bw_if_type;
 
+public:
+	// Data of one access, BUSWIDTH bits wide.
+	typedef typename bus_data<BUSWIDTH>::type data_t;
+
+private:
+	typedef basic_direct_access<data_t> direct_access;
+	typedef basic_direct_target<data_t> direct_target;
+
 public:
 	initiator_socket()
 	    : base_type(sc_core::sc_gen_unique_name(kind())),
-	      time(sc_core::SC_ZERO_TIME) {
+	      loosely_timed(false), approximately_timed(false), at_depth(1),
+	      at_end_req_peq(sc_core::sc_gen_unique_name("end_req_peq")),
+	      at_resp_peq(sc_core::sc_gen_unique_name("resp_peq")),
+	      stats(this) {
 		init();
 	}
 
 	explicit initiator_socket(const char *name)
-	    : base_type(name), time(sc_core::SC_ZERO_TIME) {
+	    : base_type(name), loosely_timed(false), approximately_timed(false),
+	      at_depth(1),
+	      at_end_req_peq(sc_core::sc_gen_unique_name("end_req_peq")),
+	      at_resp_peq(sc_core::sc_gen_unique_name("resp_peq")),
+	      stats(this) {
 		init();
 	}
 
-	~initiator_socket() {
-		tlm::tlm_generic_payload *trans;
-		while (!container.empty()) {
-			trans = container.back();
-			container.pop_back();
-			delete trans;
-		}
+	tlm::tlm_response_status read(const addr_t &addr, data_t &data,
+	                              int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s = read(addr, data, t, port);
+		set_local_time(t);
+		return s;
+	}
+
+	tlm::tlm_response_status write(const addr_t &addr, data_t data,
+	                               int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s = write(addr, data, t, port);
+		set_local_time(t);
+		return s;
+	}
+
+	// Block transfers: read/write n consecutive data_t starting at
+	// addr, in a single transaction.
+	tlm::tlm_response_status read_block(const addr_t &addr, data_t *data,
+	                                    unsigned int n, int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s = read_block(addr, data, n, t, port);
+		set_local_time(t);
+		return s;
 	}
 
+	tlm::tlm_response_status write_block(const addr_t &addr,
+	                                     const data_t *data, unsigned int n,
+	                                     int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s =
+		    write_block(addr, data, n, t, port);
+		set_local_time(t);
+		return s;
+	}
+
+	// Timed versions of the above: t is the local time offset sent
+	// with the transaction, and the duration of the access is added to
+	// it. These never synchronize with the kernel, which lets
+	// interconnects forward the offset they received.
 	tlm::tlm_response_status read(const addr_t &addr, data_t &data,
-	                              int port = 0) {
-		tlm::tlm_generic_payload *trans;
-		// allocate the payload
-		if (!container.empty()) {
-			trans = container.back();
-			container.pop_back();
+	                              sc_core::sc_time &t, int port = 0) {
+		return access(tlm::TLM_READ_COMMAND, addr,
+		              reinterpret_cast<unsigned char *>(&data),
+		              sizeof(data_t), t, port);
+	}
+
+	tlm::tlm_response_status write(const addr_t &addr, data_t data,
+	                               sc_core::sc_time &t, int port = 0) {
+		return access(tlm::TLM_WRITE_COMMAND, addr,
+		              reinterpret_cast<unsigned char *>(&data),
+		              sizeof(data_t), t, port);
+	}
+
+	tlm::tlm_response_status read_block(const addr_t &addr, data_t *data,
+	                                    unsigned int n, sc_core::sc_time &t,
+	                                    int port = 0) {
+		return access(tlm::TLM_READ_COMMAND, addr,
+		              reinterpret_cast<unsigned char *>(data),
+		              n * sizeof(data_t), t, port);
+	}
+
+	tlm::tlm_response_status write_block(const addr_t &addr,
+	                                     const data_t *data, unsigned int n,
+	                                     sc_core::sc_time &t, int port = 0) {
+		// The payload's data pointer is not const, but targets do
+		// not modify the data of a write command.
+		return access(tlm::TLM_WRITE_COMMAND, addr,
+		              reinterpret_cast<unsigned char *>(
+		                  const_cast<data_t *>(data)),
+		              n * sizeof(data_t), t, port);
+	}
+
+	// Sub-word accesses. Reads fetch the whole data_t containing addr,
+	// writes only modify the addressed bytes. addr must be a multiple
+	// of the access size.
+	tlm::tlm_response_status read8(const addr_t &addr, uint8_t &data,
+	                               int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s = read8(addr, data, t, port);
+		set_local_time(t);
+		return s;
+	}
+
+	tlm::tlm_response_status read16(const addr_t &addr, uint16_t &data,
+	                                int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s = read16(addr, data, t, port);
+		set_local_time(t);
+		return s;
+	}
+
+	tlm::tlm_response_status write8(const addr_t &addr, uint8_t data,
+	                                int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s = write8(addr, data, t, port);
+		set_local_time(t);
+		return s;
+	}
+
+	tlm::tlm_response_status write16(const addr_t &addr, uint16_t data,
+	                                 int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s = write16(addr, data, t, port);
+		set_local_time(t);
+		return s;
+	}
+
+	// Write the bytes of data enabled in be (bit i enables the byte at
+	// addr + i) in a single transaction, using the byte enables of the
+	// payload. addr must be aligned on a data_t.
+	tlm::tlm_response_status write_masked(const addr_t &addr, data_t data,
+	                                      unsigned int be, int port = 0) {
+		sc_core::sc_time t = local_time();
+		tlm::tlm_response_status s =
+		    write_masked(addr, data, be, t, port);
+		set_local_time(t);
+		return s;
+	}
+
+	tlm::tlm_response_status read8(const addr_t &addr, uint8_t &data,
+	                               sc_core::sc_time &t, int port = 0) {
+		return read_bytes(addr, &data, 1, t, port);
+	}
+
+	tlm::tlm_response_status read16(const addr_t &addr, uint16_t &data,
+	                                sc_core::sc_time &t, int port = 0) {
+		return read_bytes(addr, reinterpret_cast<unsigned char *>(&data),
+		                  2, t, port);
+	}
+
+	tlm::tlm_response_status write8(const addr_t &addr, uint8_t data,
+	                                sc_core::sc_time &t, int port = 0) {
+		return write_bytes(addr, &data, 1, t, port);
+	}
+
+	tlm::tlm_response_status write16(const addr_t &addr, uint16_t data,
+	                                 sc_core::sc_time &t, int port = 0) {
+		return write_bytes(addr,
+		                   reinterpret_cast<const unsigned char *>(&data),
+		                   2, t, port);
+	}
+
+	tlm::tlm_response_status write_masked(const addr_t &addr, data_t data,
+	                                      unsigned int be,
+	                                      sc_core::sc_time &t,
+	                                      int port = 0) {
+		if (be == (1u << sizeof(data_t)) - 1)
+			return write(addr, data, t, port);
+		if (be == 0)
+			return tlm::TLM_OK_RESPONSE;
+
+		const unsigned char *bytes =
+		    reinterpret_cast<const unsigned char *>(&data);
+		unsigned char byte_enable[sizeof(data_t)];
+		for (unsigned int i = 0; i < sizeof(data_t); ++i)
+			byte_enable[i] = be & (1u << i) ? tlm::TLM_BYTE_ENABLED
+			                                : tlm::TLM_BYTE_DISABLED;
+		unsigned int length = __builtin_popcount(be);
+		uint64_t start;
+		tlm::tlm_response_status s;
+		if (approximately_timed) {
+			start = socket_stats::start();
+			s = at_transport(tlm::TLM_WRITE_COMMAND, addr,
+			                 const_cast<unsigned char *>(bytes),
+			                 sizeof(data_t), t, port, byte_enable);
+			stats.count(tlm::TLM_WRITE_COMMAND, length, s, start);
+			return s;
+		}
+
+		dmi_region *r =
+		    find_dmi(tlm::TLM_WRITE_COMMAND, addr, sizeof(data_t), port);
+		if (r) {
+			unsigned char *p = r->dmi.get_dmi_ptr() +
+			                   (addr - r->dmi.get_start_address());
+			for (unsigned int i = 0; i < sizeof(data_t); ++i)
+				if (be & (1u << i))
+					p[i] = bytes[i];
+			t += r->dmi.get_write_latency();
+			stats.count_dmi(tlm::TLM_WRITE_COMMAND, length);
+			return tlm::TLM_OK_RESPONSE;
+		}
+
+		start = socket_stats::start();
+		if (has_direct_access(port)) {
+			const direct_access &d = direct[port];
+			s = d.write_masked(d.target, addr, data, be, t);
+			stats.count(tlm::TLM_WRITE_COMMAND, length, s, start);
+			if (d.dmi_hint && s == tlm::TLM_OK_RESPONSE)
+				request_dmi(addr, port);
+			return s;
+		}
+
+		s = transport(tlm::TLM_WRITE_COMMAND, addr,
+		              const_cast<unsigned char *>(bytes), sizeof(data_t),
+		              t, port, byte_enable);
+		stats.count(tlm::TLM_WRITE_COMMAND, length, s, start);
+		return s;
+	}
+
+	// Debug accesses: copy length bytes from/to the target at addr,
+	// without side effects and without consuming time. Return the
+	// number of bytes actually copied, which may be less than length
+	// if the target does not support debug accesses for all of them.
+	unsigned int debug_read(const addr_t &addr, unsigned char *data,
+	                        unsigned int length, int port = 0) {
+		return transport_dbg(tlm::TLM_READ_COMMAND, addr, data, length,
+		                     port);
+	}
+
+	unsigned int debug_write(const addr_t &addr, const unsigned char *data,
+	                         unsigned int length, int port = 0) {
+		return transport_dbg(tlm::TLM_WRITE_COMMAND, addr,
+		                     const_cast<unsigned char *>(data), length,
+		                     port);
+	}
+
+	// Loosely-timed mode (temporal decoupling): the initiator runs
+	// ahead of the SystemC kernel, accumulating a local time offset,
+	// and only synchronizes when the global quantum is exhausted. The
+	// quantum is set with
+	// tlm_utils::tlm_quantumkeeper::set_global_quantum().
+	void set_loosely_timed(bool enable) {
+		if (loosely_timed && !enable)
+			quantum_keeper.sync();
+		loosely_timed = enable;
+		quantum_keeper.reset();
+	}
+
+	bool is_loosely_timed() const {
+		return loosely_timed;
+	}
+
+	// Approximately-timed mode: every access goes through
+	// nb_transport_fw with the four phases of the base protocol,
+	// without DMI nor direct calls, and the initiator waits until the
+	// response. The offset given to the timed accesses is waited for
+	// before sending the request, and is zero on return. Blocks are
+	// split into one transaction per data_t, with up to depth of them
+	// outstanding at once (the requests are still sent one at a
+	// time). Enabling this mode disables the loosely-timed one.
+	void set_approximately_timed(bool enable, unsigned int depth = 1) {
+		if (enable)
+			set_loosely_timed(false);
+		approximately_timed = enable;
+		at_depth = depth ? depth : 1;
+	}
+
+	bool is_approximately_timed() const {
+		return approximately_timed;
+	}
+
+	// Accesses made so far (see stats.h).
+	const socket_stats &statistics() const {
+		return stats;
+	}
+
+	// Let time t pass for the initiator. In loosely-timed mode, this
+	// only adds t to the local time offset (and synchronizes if the
+	// quantum is exhausted), otherwise this is a plain wait(t).
+	void advance(const sc_core::sc_time &t) {
+		if (loosely_timed) {
+			quantum_keeper.inc(t);
+			if (quantum_keeper.need_sync())
+				quantum_keeper.sync();
 		} else {
-			trans = new tlm::tlm_generic_payload();
+			sc_core::wait(t);
 		}
+	}
 
-		// build the payload ...
+	// Synchronize with the SystemC kernel now, e.g. before waiting for
+	// an event.
+	void sync() {
+		if (loosely_timed)
+			quantum_keeper.sync();
+	}
+
+	// Local time offset of the initiator (always zero when not
+	// loosely-timed).
+	sc_core::sc_time local_time() const {
+		return quantum_keeper.get_local_time();
+	}
+
+	// Set the local time offset, typically to the value returned by a
+	// timed access. When not loosely-timed, this waits for t instead.
+	void set_local_time(const sc_core::sc_time &t) {
+		if (loosely_timed) {
+			quantum_keeper.set(t);
+			if (quantum_keeper.need_sync())
+				quantum_keeper.sync();
+		} else if (t != sc_core::SC_ZERO_TIME) {
+			sc_core::wait(t);
+		}
+	}
+
+	// Time of the initiator, which is ahead of sc_time_stamp() by the
+	// local time offset in loosely-timed mode.
+	sc_core::sc_time current_time() const {
+		return quantum_keeper.get_current_time();
+	}
+
+	// True when the accesses at addr go through a DMI pointer, which is
+	// only known after a first access to its region.
+	bool is_direct(const addr_t &addr, int port = 0) {
+		return find_dmi(tlm::TLM_READ_COMMAND,
+		                addr & ~addr_t(sizeof(data_t) - 1),
+		                sizeof(data_t), port) != NULL;
+	}
+
+	virtual const char *kind() const {
+		return "ensitlm::initiator_socket";
+	}
+
+	// Ask the target bound to port for a DMI pointer to the region
+	// containing addr. The answer is not recorded by the socket: this
+	// is meant for interconnects forwarding the request of their own
+	// initiators.
+	bool get_direct_mem_ptr(const addr_t &addr, tlm::tlm_dmi &dmi,
+	                        int port = 0) {
+		tlm::tlm_generic_payload *trans = new_payload();
 		trans->set_command(tlm::TLM_READ_COMMAND);
+		trans->set_address(addr);
+
+		bool granted = (*this)[port]->get_direct_mem_ptr(*trans, dmi);
+		trans->release();
+		return granted;
+	}
+
+	// Forget about every DMI region (granted or refused) overlapping
+	// [start, end], on all ports, then let the module forward the
+	// invalidation if it wants to.
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end) {
+		size_t i = 0;
+		while (i < dmi_regions.size()) {
+			const tlm::tlm_dmi &dmi = dmi_regions[i].dmi;
+			if (dmi.get_start_address() <= end &&
+			    dmi.get_end_address() >= start) {
+				dmi_regions[i] = dmi_regions.back();
+				dmi_regions.pop_back();
+			} else {
+				++i;
+			}
+		}
+		module_invalidate_direct_mem_ptr(
+		    start, end, hooks::has_invalidate_direct_mem_ptr<MODULE>());
+	}
+
+	// Phases sent back by the target in approximately-timed mode. The
+	// responses are accepted immediately, which ends the transaction.
+	tlm::tlm_sync_enum nb_transport_bw(tlm::tlm_generic_payload &trans,
+	                                   tlm::tlm_phase &phase,
+	                                   sc_core::sc_time &t) {
+		switch (phase) {
+		case tlm::END_REQ:
+			at_end_req_peq.notify(trans, t);
+			return tlm::TLM_ACCEPTED;
+		case tlm::BEGIN_RESP:
+			at_resp_peq.notify(trans, t);
+			phase = tlm::END_RESP;
+			return tlm::TLM_COMPLETED;
+		default:
+			std::cerr << this->name() << ": unexpected phase "
+			          << phase << " in nb_transport_bw" << std::endl;
+			abort();
+		}
+	}
+
+private:
+	// Loosely-timed mode: the transactions carry the local time
+	// offset held by the quantum keeper.
+	bool loosely_timed;
+	tlm_utils::tlm_quantumkeeper quantum_keeper;
+
+	// Approximately-timed mode: END_REQ and BEGIN_RESP phases
+	// received, at the time they take effect.
+	bool approximately_timed;
+	unsigned int at_depth;
+	tlm_utils::peq_with_get<tlm::tlm_generic_payload> at_end_req_peq;
+	tlm_utils::peq_with_get<tlm::tlm_generic_payload> at_resp_peq;
+
+	// Accesses made through this socket (see stats.h).
+	socket_stats stats;
+
+	// Payloads come from the shared memory manager (see mm.h), and
+	// are released once the transaction is over.
+	static tlm::tlm_generic_payload *new_payload() {
+		return mm::instance().allocate();
+	}
+
+	void fill_payload(tlm::tlm_generic_payload *trans,
+	                  tlm::tlm_command command, const addr_t &addr,
+	                  unsigned char *data, unsigned int length,
+	                  unsigned char *byte_enable) {
+		trans->set_command(command);
 		trans->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
 		trans->set_address(addr);
 
-		trans->set_data_ptr(reinterpret_cast<unsigned char *>(&data));
-		// No block transaction => just one piece of data
-		trans->set_data_length(sizeof(data_t));
+		trans->set_data_ptr(data);
+		trans->set_data_length(length);
 		// no streaming => streaming_width == data_length
-		trans->set_streaming_width(sizeof(data_t));
+		trans->set_streaming_width(length);
+		trans->set_byte_enable_ptr(byte_enable);
+		trans->set_byte_enable_length(byte_enable ? length : 0);
+		trans->set_dmi_allowed(false);
+		mm::extension<origin>(*trans)->initiator = backward();
+	}
+
+	// Backward interface of the socket, which identifies it to the
+	// targets (it is a public base, so that they can also find its
+	// name).
+	const bw_if_type *backward() const {
+		return static_cast<const bw_if_type *>(this);
+	}
+
+	// Read or write length bytes at addr, through DMI when possible.
+	tlm::tlm_response_status access(tlm::tlm_command command,
+	                                const addr_t &addr, unsigned char *data,
+	                                unsigned int length, sc_core::sc_time &t,
+	                                int port) {
+		uint64_t start;
+		tlm::tlm_response_status s;
+		if (approximately_timed) {
+			start = socket_stats::start();
+			s = at_transport(command, addr, data, length, t, port);
+			stats.count(command, length, s, start);
+			return s;
+		}
+		dmi_region *r = find_dmi(command, addr, length, port);
+		if (r) {
+			unsigned char *p = r->dmi.get_dmi_ptr() +
+			                   (addr - r->dmi.get_start_address());
+			// The DMI latency is per data_t
+			unsigned int n = length / sizeof(data_t);
+			if (command == tlm::TLM_READ_COMMAND) {
+				memcpy(data, p, length);
+				t += n == 1 ? r->dmi.get_read_latency()
+				            : r->dmi.get_read_latency() * n;
+			} else {
+				memcpy(p, data, length);
+				t += n == 1 ? r->dmi.get_write_latency()
+				            : r->dmi.get_write_latency() * n;
+			}
+			stats.count_dmi(command, length);
+			return tlm::TLM_OK_RESPONSE;
+		}
+		start = socket_stats::start();
+		if (length == sizeof(data_t) && has_direct_access(port)) {
+			const direct_access &d = direct[port];
+			data_t &word = *reinterpret_cast<data_t *>(data);
+			s = command == tlm::TLM_READ_COMMAND
+			        ? d.read(d.target, addr, word, t)
+			        : d.write(d.target, addr, word, t);
+			stats.count(command, length, s, start);
+			if (d.dmi_hint && s == tlm::TLM_OK_RESPONSE)
+				request_dmi(addr, port);
+			return s;
+		}
+		s = transport(command, addr, data, length, t, port);
+		stats.count(command, length, s, start);
+		return s;
+	}
+
+	// Sub-word accesses, done on the data_t containing addr.
+	tlm::tlm_response_status read_bytes(const addr_t &addr,
+	                                    unsigned char *data,
+	                                    unsigned int length,
+	                                    sc_core::sc_time &t, int port) {
+		unsigned int offset = addr % sizeof(data_t);
+		if (addr % length)
+			return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+		data_t word;
+		tlm::tlm_response_status s = read(addr - offset, word, t, port);
+		if (s == tlm::TLM_OK_RESPONSE)
+			memcpy(data, reinterpret_cast<unsigned char *>(&word) +
+			                 offset,
+			       length);
+		return s;
+	}
+
+	tlm::tlm_response_status write_bytes(const addr_t &addr,
+	                                     const unsigned char *data,
+	                                     unsigned int length,
+	                                     sc_core::sc_time &t, int port) {
+		unsigned int offset = addr % sizeof(data_t);
+		if (addr % length)
+			return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+		data_t word = 0;
+		memcpy(reinterpret_cast<unsigned char *>(&word) + offset, data,
+		       length);
+		return write_masked(addr - offset, word,
+		                    ((1u << length) - 1) << offset, t, port);
+	}
+
+	tlm::tlm_response_status transport(tlm::tlm_command command,
+	                                   const addr_t &addr,
+	                                   unsigned char *data,
+	                                   unsigned int length,
+	                                   sc_core::sc_time &t, int port,
+	                                   unsigned char *byte_enable = NULL) {
+		// build the payload ...
+		tlm::tlm_generic_payload *trans = new_payload();
+		fill_payload(trans, command, addr, data, length, byte_enable);
 
 		// ... and send it.
-		(*this)[port]->b_transport(*trans, time);
+		(*this)[port]->b_transport(*trans, t);
 
-		container.push_back(trans);
+		bool dmi_allowed = trans->is_dmi_allowed();
+		tlm::tlm_response_status s = trans->get_response_status();
+		trans->release();
 
-		return trans->get_response_status();
+		if (dmi_allowed)
+			request_dmi(addr, port);
+		return s;
 	}
 
-	tlm::tlm_response_status write(const addr_t &addr, data_t data,
-	                               int port = 0) {
-		tlm::tlm_generic_payload *trans;
+	// Approximately-timed version of transport(): one transaction per
+	// data_t, at most at_depth of them outstanding. Returns the first
+	// error, if any.
+	tlm::tlm_response_status at_transport(tlm::tlm_command command,
+	                                      const addr_t &addr,
+	                                      unsigned char *data,
+	                                      unsigned int length,
+	                                      sc_core::sc_time &t, int port,
+	                                      unsigned char *byte_enable = NULL) {
+		if (t != sc_core::SC_ZERO_TIME) {
+			sc_core::wait(t);
+			t = sc_core::SC_ZERO_TIME;
+		}
 
-		if (!container.empty()) {
-			trans = container.back();
-			container.pop_back();
-		} else {
-			trans = new tlm::tlm_generic_payload();
+		unsigned int beat = length > sizeof(data_t) ? sizeof(data_t)
+		                                            : length;
+		unsigned int beats = (length + beat - 1) / beat;
+		unsigned int sent = 0, received = 0;
+		// Request in its request phase (at most one at a time).
+		tlm::tlm_generic_payload *requesting = NULL;
+		tlm::tlm_response_status status = tlm::TLM_OK_RESPONSE;
+
+		while (received < beats) {
+			tlm::tlm_generic_payload *trans;
+			while ((trans = at_end_req_peq.get_next_transaction()))
+				if (trans == requesting)
+					requesting = NULL;
+			while ((trans = at_resp_peq.get_next_transaction())) {
+				// BEGIN_RESP also ends the request phase.
+				if (trans == requesting)
+					requesting = NULL;
+				if (status == tlm::TLM_OK_RESPONSE)
+					status = trans->get_response_status();
+				trans->release();
+				++received;
+			}
+			if (received == beats)
+				break;
+
+			if (!requesting && sent < beats &&
+			    sent - received < at_depth) {
+				trans = new_payload();
+				fill_payload(trans, command, addr + sent * beat,
+				             data + sent * beat,
+				             std::min(beat, length - sent * beat),
+				             byte_enable);
+				++sent;
+				requesting = at_begin_req(*trans, port) ? NULL
+				                                        : trans;
+				continue;
+			}
+			sc_core::wait(at_end_req_peq.get_event() |
+			              at_resp_peq.get_event());
 		}
+		return status;
+	}
 
-		trans->set_command(tlm::TLM_WRITE_COMMAND);
-		trans->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+	// Send the request, return true if its request phase is already
+	// over.
+	bool at_begin_req(tlm::tlm_generic_payload &trans, int port) {
+		tlm::tlm_phase phase = tlm::BEGIN_REQ;
+		sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+		switch ((*this)[port]->nb_transport_fw(trans, phase, delay)) {
+		case tlm::TLM_ACCEPTED:
+			// END_REQ or BEGIN_RESP will come on the backward path.
+			return false;
+		case tlm::TLM_UPDATED:
+			if (phase == tlm::END_REQ) {
+				at_end_req_peq.notify(trans, delay);
+				return false;
+			} else if (phase == tlm::BEGIN_RESP) {
+				at_resp_peq.notify(trans, delay);
+				phase = tlm::END_RESP;
+				delay = sc_core::SC_ZERO_TIME;
+				(*this)[port]->nb_transport_fw(trans, phase, delay);
+				return true;
+			}
+			std::cerr << this->name() << ": unexpected phase " << phase
+			          << " from nb_transport_fw" << std::endl;
+			abort();
+		case tlm::TLM_COMPLETED:
+			at_resp_peq.notify(trans, delay);
+			return true;
+		}
+		return true;
+	}
+
+	unsigned int transport_dbg(tlm::tlm_command command,
+	                           const addr_t &addr, unsigned char *data,
+	                           unsigned int length, int port) {
+		tlm::tlm_generic_payload *trans = new_payload();
+		trans->set_command(command);
 		trans->set_address(addr);
+		trans->set_data_ptr(data);
+		trans->set_data_length(length);
 
-		trans->set_data_ptr(reinterpret_cast<unsigned char *>(&data));
-		trans->set_data_length(sizeof(data_t));
-		trans->set_streaming_width(sizeof(data_t));
+		unsigned int n = (*this)[port]->transport_dbg(*trans);
 
-		(*this)[port]->b_transport(*trans, time);
+		trans->release();
+		return n;
+	}
 
-		container.push_back(trans);
+	// Direct calls to the ensitlm targets, per port (see
+	// direct_access.h).
+	std::vector<direct_access> direct;
 
-		return trans->get_response_status();
+	bool has_direct_access(int port) const {
+		return size_t(port) < direct.size() && direct[port].target;
 	}
 
-	virtual const char *kind() const {
-		return "ensitlm::initiator_socket";
+	void end_of_elaboration() {
+		base_type::end_of_elaboration();
+		direct.assign(this->size(), direct_access());
+		if (force_tlm())
+			return;
+		for (int i = 0; i < this->size(); ++i) {
+			direct_target *target =
+			    dynamic_cast<direct_target *>((*this)[i]);
+			if (target)
+				target->get_direct_access(direct[i],
+				                          backward());
+		}
 	}
 
-	void invalidate_direct_mem_ptr(sc_dt::uint64, sc_dt::uint64) {
-		std::cerr << "invalidate_direct_mem_ptr not implemented"
-		          << std::endl;
-		abort();
+	// DMI regions returned by the targets. A region with no granted
+	// access records a refusal, so that the target is not asked again
+	// for addresses within it.
+	struct dmi_region {
+		int port;
+		tlm::tlm_dmi dmi;
+	};
+	std::vector<dmi_region> dmi_regions;
+
+	// Return the region of port containing the length bytes at addr,
+	// or NULL if we know nothing about these addresses yet.
+	dmi_region *find_dmi_region(const addr_t &addr, unsigned int length,
+	                            int port) {
+		sc_dt::uint64 last = sc_dt::uint64(addr) + length - 1;
+		for (size_t i = 0; i < dmi_regions.size(); ++i) {
+			dmi_region &r = dmi_regions[i];
+			if (r.port == port &&
+			    addr >= r.dmi.get_start_address() &&
+			    last <= r.dmi.get_end_address()) {
+				// Keep the most recently used region first,
+				// lookups are then almost always immediate.
+				if (i != 0) {
+					std::swap(r, dmi_regions[0]);
+					return &dmi_regions[0];
+				}
+				return &r;
+			}
+		}
+		return NULL;
 	}
 
-	tlm::tlm_sync_enum nb_transport_bw(tlm::tlm_generic_payload &,
-	                                   tlm::tlm_phase &,
-	                                   sc_core::sc_time &) {
-		std::cerr << "nb_transport_bw not implemented" << std::endl;
-		abort();
+	// Return the DMI region to use for this access, or NULL if it must
+	// go through b_transport.
+	dmi_region *find_dmi(tlm::tlm_command command, const addr_t &addr,
+	                     unsigned int length, int port) {
+		if (dmi_regions.empty() || addr % sizeof(data_t))
+			return NULL;
+		dmi_region *r = find_dmi_region(addr, length, port);
+		if (r && dmi_allows(r->dmi, command))
+			return r;
+		return NULL;
 	}
 
-private:
-	// container to keep the unused payloads (avoids calling new too often)
-	std::vector<tlm::tlm_generic_payload *> container;
+	static bool dmi_allows(const tlm::tlm_dmi &dmi,
+	                       tlm::tlm_command command) {
+		return command == tlm::TLM_READ_COMMAND ? dmi.is_read_allowed()
+		                                        : dmi.is_write_allowed();
+	}
+
+	// The target told us DMI was possible for addr: ask for a pointer,
+	// unless we already have an answer for this address.
+	void request_dmi(const addr_t &addr, int port) {
+		if (find_dmi_region(addr, sizeof(data_t), port))
+			return;
 
-	// zero time, but allocated once and for all for performance reasons.
-	sc_core::sc_time time;
+		dmi_region r;
+		r.port = port;
+		if (!get_direct_mem_ptr(addr, r.dmi, port))
+			r.dmi.allow_none();
+
+		// The answer must at least cover the address we asked
+		// for, otherwise we would ask again and again.
+		if (addr < r.dmi.get_start_address() ||
+		    addr > r.dmi.get_end_address()) {
+			std::cerr << this->name()
+			          << ": target returned a DMI region not "
+			             "containing the requested address"
+			          << std::endl;
+			abort();
+		}
+		dmi_regions.push_back(r);
+	}
+
+	void module_invalidate_direct_mem_ptr(sc_dt::uint64 start,
+	                                      sc_dt::uint64 end,
+	                                      std::true_type) {
+		// Looked up on demand: only interconnects need this, and
+		// invalidations are rare.
+		MODULE *mod = dynamic_cast<MODULE *>(this->get_parent_object());
+		if (!mod) {
+			std::cerr << this->name()
+			          << ": parent object of socket has the wrong "
+			             "type."
+			          << std::endl;
+			abort();
+		}
+		mod->invalidate_direct_mem_ptr(start, end);
+	}
+
+	void module_invalidate_direct_mem_ptr(sc_dt::uint64, sc_dt::uint64,
+	                                      std::false_type) {
+	}
 
 	void init() {
 		// we're not actually using the backward interface,
@@ -0,0 +1,42 @@
+#include "ensitlm.h"
+#include "mm.h"
+
+namespace ensitlm {
+
+mm &mm::instance() {
+	static mm the_mm;
+	return the_mm;
+}
+
+mm::mm() {
+}
+
+mm::~mm() {
+	for (size_t i = 0; i < chunks.size(); ++i)
+		delete[] chunks[i];
+}
+
+tlm::tlm_generic_payload *mm::allocate() {
+	if (free_list.empty()) {
+		tlm::tlm_generic_payload *chunk =
+		    new tlm::tlm_generic_payload[chunk_size];
+		chunks.push_back(chunk);
+		// Hand out the payloads of the chunk in address order.
+		for (size_t i = chunk_size; i-- > 0;) {
+			chunk[i].set_mm(this);
+			free_list.push_back(&chunk[i]);
+		}
+	}
+	tlm::tlm_generic_payload *trans = free_list.back();
+	free_list.pop_back();
+	trans->acquire();
+	return trans;
+}
+
+void mm::free(tlm::tlm_generic_payload *trans) {
+	// Frees the auto extensions, the others are kept for the next
+	// user of the payload.
+	trans->reset();
+	free_list.push_back(trans);
+}
+}
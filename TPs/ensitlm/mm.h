@@ -0,0 +1,71 @@
+#ifndef ENSITLM_MM_H
+#define ENSITLM_MM_H
+
+#include "ensitlm.h"
+
+#include <vector>
+
+namespace ensitlm {
+
+// Memory manager of the generic payloads, shared by all the ensitlm
+// initiator sockets of the simulation (and by anyone needing a
+// payload with a memory manager).
+//
+// Payloads are allocated by chunks and never given back to the heap:
+// released payloads go to a free list and are handed out again by
+// allocate(). A payload returned by allocate() has a reference count of
+// one and goes back to the free list when its last reference is
+// released, so that it may be kept past the call that created it
+// (pipelined transactions, traces, ...).
+//
+// Extensions attached with set_extension() stay attached when the
+// payload is recycled: extension<T>() creates the extension the first
+// time it is asked on a payload, and returns the same object afterwards.
+// Extensions attached with set_auto_extension() are freed when the
+// payload is recycled, as with any TLM memory manager.
+class mm : public tlm::tlm_mm_interface {
+public:
+	static mm &instance();
+
+	tlm::tlm_generic_payload *allocate();
+
+	// Called by tlm_generic_payload::release(), do not call directly.
+	void free(tlm::tlm_generic_payload *trans);
+
+	// Reusable extension of type EXT of trans. The fields of the
+	// extension are left as the previous user of the payload left
+	// them.
+	template <typename EXT>
+	static EXT *extension(tlm::tlm_generic_payload &trans) {
+		EXT *ext = trans.template get_extension<EXT>();
+		if (!ext) {
+			ext = new EXT();
+			trans.set_extension(ext);
+		}
+		return ext;
+	}
+
+	// Number of payloads allocated so far, and of unused ones.
+	size_t size() const {
+		return chunks.size() * chunk_size;
+	}
+
+	size_t available() const {
+		return free_list.size();
+	}
+
+	~mm();
+
+private:
+	static const size_t chunk_size = 64;
+
+	mm();
+	mm(const mm &);
+	mm &operator=(const mm &);
+
+	std::vector<tlm::tlm_generic_payload *> chunks;
+	std::vector<tlm::tlm_generic_payload *> free_list;
+};
+}
+
+#endif
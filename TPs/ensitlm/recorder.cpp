@@ -0,0 +1,113 @@
+#include "ensitlm.h"
+#include "recorder.h"
+
+#include <iostream>
+#include <sstream>
+
+namespace ensitlm {
+
+recorder::recorder(const char *file,
+                   const std::vector<std::string> &initiators,
+                   const std::vector<std::string> &targets)
+    : file_name(file), failed(false), ring(block_size * nb_blocks),
+      filled(0), written(0), closing(false) {
+	this->file = fopen(file, "wb");
+	if (!this->file) {
+		std::cerr << "ensitlm: cannot create trace file " << file
+		          << std::endl;
+		abort();
+	}
+
+	std::string names;
+	for (size_t i = 0; i < initiators.size(); ++i)
+		names.append(initiators[i].c_str(), initiators[i].size() + 1);
+	for (size_t i = 0; i < targets.size(); ++i)
+		names.append(targets[i].c_str(), targets[i].size() + 1);
+
+	trace::header h;
+	memcpy(h.magic, trace::magic, sizeof(h.magic));
+	h.version = trace::version;
+	h.record_size = sizeof(trace::record);
+	h.resolution_fs = static_cast<uint64_t>(
+	    sc_core::sc_get_time_resolution().to_seconds() * 1e15 + 0.5);
+	h.initiators = initiators.size();
+	h.targets = targets.size();
+	h.names_size = names.size();
+	if (fwrite(&h, sizeof(h), 1, this->file) != 1 ||
+	    fwrite(names.data(), 1, names.size(), this->file) != names.size()) {
+		std::cerr << "ensitlm: cannot write trace file " << file
+		          << std::endl;
+		abort();
+	}
+
+	next = &ring[0];
+	end = next + block_size;
+	thread = std::thread(&recorder::writer, this);
+}
+
+recorder::~recorder() {
+	{
+		std::lock_guard<std::mutex> l(lock);
+		closing = true;
+	}
+	changed.notify_all();
+	thread.join();
+
+	// The thread wrote all the full blocks: only the current one is
+	// left.
+	write(end - block_size, next - (end - block_size));
+	if (fclose(file))
+		std::cerr << "ensitlm: cannot write trace file " << file_name
+		          << std::endl;
+}
+
+// The current block is full: hand it over to the thread, and wait until
+// the next one has been written if the ring is full.
+void recorder::next_block() {
+	std::unique_lock<std::mutex> l(lock);
+	++filled;
+	changed.notify_all();
+	while (filled - written == nb_blocks)
+		changed.wait(l);
+	next = &ring[(filled % nb_blocks) * block_size];
+	end = next + block_size;
+}
+
+void recorder::writer() {
+	std::unique_lock<std::mutex> l(lock);
+	for (;;) {
+		while (written == filled && !closing)
+			changed.wait(l);
+		if (written == filled)
+			return;
+		const trace::record *block =
+		    &ring[(written % nb_blocks) * block_size];
+		// The simulation does not touch the block until written
+		// changes.
+		l.unlock();
+		write(block, block_size);
+		l.lock();
+		++written;
+		changed.notify_all();
+	}
+}
+
+void recorder::write(const trace::record *records, size_t n) {
+	if (n && fwrite(records, sizeof(*records), n, file) != n && !failed) {
+		std::cerr << "ensitlm: cannot write trace file " << file_name
+		          << std::endl;
+		failed = true;
+	}
+}
+
+std::string recorder::name_of(const sc_core::sc_interface *itf,
+                              const char *kind, int i) {
+	const sc_core::sc_object *obj =
+	    dynamic_cast<const sc_core::sc_object *>(itf);
+	if (obj)
+		return obj->name();
+	std::ostringstream s;
+	s << kind << " " << i;
+	return s.str();
+}
+}
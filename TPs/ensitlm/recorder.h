@@ -0,0 +1,108 @@
+#ifndef ENSITLM_RECORDER_H
+#define ENSITLM_RECORDER_H
+
+#include "ensitlm.h"
+#include "trace_format.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ensitlm {
+
+// Binary trace of the transactions going through an interconnect (see
+// trace_format.h), enabled with record_to() on Bus and FastBus and read
+// by tools/trace-analyzer.
+//
+// Records are written into a ring of blocks in memory, and a host
+// thread writes the full blocks to the file, so that the simulation
+// only pays for filling a record. When the thread falls behind and the
+// ring is full, the simulation waits for it: no record is ever lost.
+class recorder {
+public:
+	// Create (or truncate) file, and start the writing thread. The
+	// names are those of the initiators and of the targets, in index
+	// order.
+	recorder(const char *file, const std::vector<std::string> &initiators,
+	         const std::vector<std::string> &targets);
+
+	// Write the remaining records and close the file.
+	~recorder();
+
+	// Record an access of initiator to target (trace::none if unknown)
+	// at address a of the bus, ending at local time offset t. data is
+	// the first data word of the access.
+	void record(const sc_core::sc_time &t, int initiator, int target,
+	            addr_t a, uint64_t data, tlm::tlm_command command,
+	            unsigned int length, tlm::tlm_response_status s) {
+		if (next == end)
+			next_block();
+		trace::record &r = *next++;
+		r.time = (sc_core::sc_time_stamp() + t).value();
+		r.data = data;
+		r.address = a;
+		r.initiator = initiator < 0 ? trace::none : initiator;
+		r.target = target < 0 ? trace::none : target;
+		r.length = length < 0xffff ? length : 0xffff;
+		r.command = command;
+		r.status = s;
+		r.reserved = 0;
+	}
+
+	// Same, for a transaction whose response status is set.
+	void record(const sc_core::sc_time &t, int initiator, int target,
+	            addr_t a, const tlm::tlm_generic_payload &trans) {
+		uint64_t data = 0;
+		memcpy(&data, trans.get_data_ptr(),
+		       std::min<size_t>(trans.get_data_length(), sizeof(data)));
+		record(t, initiator, target, a, data, trans.get_command(),
+		       trans.get_data_length(), trans.get_response_status());
+	}
+
+	// Name of the socket or module implementing itf, or "kind i" if it
+	// is not an sc_object.
+	static std::string name_of(const sc_core::sc_interface *itf,
+	                           const char *kind, int i);
+
+	// Number of records so far.
+	uint64_t size() const {
+		return filled * block_size + (block_size - (end - next));
+	}
+
+private:
+	static const size_t block_size = 8192;
+	static const size_t nb_blocks = 8;
+
+	recorder(const recorder &);
+	recorder &operator=(const recorder &);
+
+	void next_block();
+	void writer();
+	void write(const trace::record *records, size_t n);
+
+	std::string file_name;
+	FILE *file;
+	bool failed;
+
+	std::vector<trace::record> ring;
+	// Block being filled by the simulation.
+	trace::record *next;
+	trace::record *end;
+
+	// Blocks filled by the simulation and written by the thread, since
+	// the beginning. Block i is ring block i % nb_blocks.
+	uint64_t filled;
+	uint64_t written;
+	bool closing;
+	std::mutex lock;
+	std::condition_variable changed;
+	std::thread thread;
+};
+}
+
+#endif
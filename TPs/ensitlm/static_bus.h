@@ -0,0 +1,427 @@
+#ifndef ENSITLM_STATIC_BUS_H
+#define ENSITLM_STATIC_BUS_H
+
+#include "ensitlm.h"
+
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
+
+namespace ensitlm {
+
+// One entry of the address map of a StaticBus: the target module type,
+// and the range it is mapped to.
+template <typename TARGET, addr_t BASE, addr_t SIZE> struct static_mapping {
+	static_assert(SIZE > 0, "empty address range");
+	static_assert(BASE + (SIZE - 1) >= BASE,
+	              "address range wraps around the address space");
+
+	typedef TARGET target_type;
+	static const addr_t base = BASE;
+	static const addr_t size = SIZE;
+
+	// A single comparison: addresses below BASE wrap around to large
+	// offsets.
+	static constexpr bool contains(addr_t a) {
+		return addr_t(a - BASE) < SIZE;
+	}
+};
+
+namespace detail {
+template <typename M, typename N> struct overlap {
+	static const bool value = M::base <= N::base + (N::size - 1) &&
+	                          N::base <= M::base + (M::size - 1);
+};
+
+template <typename M, typename... Ms> struct overlaps_any : std::false_type {};
+
+template <typename M, typename N, typename... Ms>
+struct overlaps_any<M, N, Ms...>
+    : std::integral_constant<bool, overlap<M, N>::value ||
+                                       overlaps_any<M, Ms...>::value> {};
+
+template <typename... Ms> struct disjoint : std::true_type {};
+
+template <typename M, typename... Ms>
+struct disjoint<M, Ms...>
+    : std::integral_constant<bool, !overlaps_any<M, Ms...>::value &&
+                                       disjoint<Ms...>::value> {};
+
+// Index of the first mapping containing A, sizeof...(Ms) if none.
+template <addr_t A, typename... Ms>
+struct index_of : std::integral_constant<size_t, 0> {};
+
+template <addr_t A, typename M, typename... Ms>
+struct index_of<A, M, Ms...>
+    : std::integral_constant<size_t, M::contains(A)
+                                         ? 0
+                                         : 1 + index_of<A, Ms...>::value> {};
+}
+
+// Alternative to Bus for platforms whose address map is known at
+// compile time, given as a list of static_mapping:
+//
+//   typedef ensitlm::StaticBus<
+//       ensitlm::static_mapping<Memory, RAM_BASEADDR, RAM_SIZE>,
+//       ensitlm::static_mapping<Timer, TIMER_BASEADDR, TIMER_SIZE> >
+//       PlatformBus;
+//
+// It is bound and mapped like a Bus (map() checks that the mapping is
+// the one of the template arguments). Reads and writes call the read
+// and write methods of the target modules directly, without going
+// through the sockets: the target is found with one comparison per
+// mapping, and can be resolved at compile time with read<A>() and
+// write<A>() when the address is a constant. Block, debug and DMI
+// requests are forwarded through the sockets, like Bus does.
+template <typename... MAPPINGS> class StaticBus : public sc_core::sc_module {
+	static const size_t N = sizeof...(MAPPINGS);
+	static_assert(N > 0, "empty address map");
+	static_assert(detail::disjoint<MAPPINGS...>::value,
+	              "address map conflict");
+
+	template <size_t I> using index = std::integral_constant<size_t, I>;
+	template <size_t I>
+	using mapping =
+	    typename std::tuple_element<I, std::tuple<MAPPINGS...> >::type;
+
+public:
+	initiator_socket<StaticBus, true> initiator;
+	target_socket<StaticBus, true> target;
+
+	StaticBus(sc_core::sc_module_name name) : sc_core::sc_module(name) {
+		std::cout << name << ": Ensitlm static bus" << std::endl;
+		for (size_t i = 0; i < N; ++i)
+			sockets[i] = NULL;
+	}
+
+	tlm::tlm_response_status read(addr_t a, data_t &d) {
+		sc_core::sc_time t = sc_core::SC_ZERO_TIME;
+		return read(a, d, t);
+	}
+
+	tlm::tlm_response_status write(addr_t a, data_t d) {
+		sc_core::sc_time t = sc_core::SC_ZERO_TIME;
+		return write(a, d, t);
+	}
+
+	tlm::tlm_response_status read(addr_t a, data_t &d, sc_core::sc_time &t) {
+		if (a % sizeof(data_t))
+			return unaligned("read", a);
+		return dispatch_read(a, d, t, index<0>());
+	}
+
+	tlm::tlm_response_status write(addr_t a, data_t d, sc_core::sc_time &t) {
+		if (a % sizeof(data_t))
+			return unaligned("write", a);
+		return dispatch_write(a, d, t, index<0>());
+	}
+
+	tlm::tlm_response_status write_masked(addr_t a, data_t d,
+	                                      unsigned int be,
+	                                      sc_core::sc_time &t) {
+		if (a % sizeof(data_t))
+			return unaligned("write", a);
+		return dispatch_write_masked(a, d, be, t, index<0>());
+	}
+
+	// Accesses at a constant address: the target is resolved at
+	// compile time.
+	template <addr_t A> tlm::tlm_response_status read(data_t &d) {
+		sc_core::sc_time t = sc_core::SC_ZERO_TIME;
+		return read<A>(d, t);
+	}
+
+	template <addr_t A> tlm::tlm_response_status write(data_t d) {
+		sc_core::sc_time t = sc_core::SC_ZERO_TIME;
+		return write<A>(d, t);
+	}
+
+	template <addr_t A>
+	tlm::tlm_response_status read(data_t &d, sc_core::sc_time &t) {
+		static const size_t I = detail::index_of<A, MAPPINGS...>::value;
+		static_assert(I < N, "no target at this address");
+		static_assert(A % sizeof(data_t) == 0, "unaligned address");
+		return hooks::call_read(*std::get<I>(modules),
+		                        A - mapping<I>::base, d, t);
+	}
+
+	template <addr_t A>
+	tlm::tlm_response_status write(data_t d, sc_core::sc_time &t) {
+		static const size_t I = detail::index_of<A, MAPPINGS...>::value;
+		static_assert(I < N, "no target at this address");
+		static_assert(A % sizeof(data_t) == 0, "unaligned address");
+		return hooks::call_write(*std::get<I>(modules),
+		                         A - mapping<I>::base, d, t);
+	}
+
+	tlm::tlm_response_status read_block(addr_t a, data_t *d, unsigned int n,
+	                                    sc_core::sc_time &t) {
+		const entry *e = find_block(a, n);
+		if (!e)
+			return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+		return initiator.read_block(a - e->begin, d, n, t, e->port);
+	}
+
+	tlm::tlm_response_status write_block(addr_t a, const data_t *d,
+	                                     unsigned int n,
+	                                     sc_core::sc_time &t) {
+		const entry *e = find_block(a, n);
+		if (!e)
+			return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+		return initiator.write_block(a - e->begin, d, n, t, e->port);
+	}
+
+	unsigned int debug_read(addr_t a, unsigned char *buf,
+	                        unsigned int length) {
+		unsigned int done = 0;
+		while (done < length) {
+			const entry *e = find(a);
+			if (!e)
+				break;
+			unsigned int n = std::min<sc_dt::uint64>(
+			    length - done, sc_dt::uint64(e->end) - a + 1);
+			unsigned int r = initiator.debug_read(
+			    a - e->begin, buf + done, n, e->port);
+			done += r;
+			if (r < n)
+				break;
+			a += n;
+		}
+		return done;
+	}
+
+	unsigned int debug_write(addr_t a, const unsigned char *buf,
+	                         unsigned int length) {
+		unsigned int done = 0;
+		while (done < length) {
+			const entry *e = find(a);
+			if (!e)
+				break;
+			unsigned int n = std::min<sc_dt::uint64>(
+			    length - done, sc_dt::uint64(e->end) - a + 1);
+			unsigned int r = initiator.debug_write(
+			    a - e->begin, buf + done, n, e->port);
+			done += r;
+			if (r < n)
+				break;
+			a += n;
+		}
+		return done;
+	}
+
+	bool get_direct_mem_ptr(addr_t a, tlm::tlm_dmi &dmi) {
+		const entry *e = find(a);
+		if (!e) {
+			dmi.set_start_address(a);
+			dmi.set_end_address(a);
+			return false;
+		}
+		bool granted =
+		    initiator.get_direct_mem_ptr(a - e->begin, dmi, e->port);
+		sc_dt::uint64 size = sc_dt::uint64(e->end) - e->begin;
+		dmi.set_start_address(e->begin + dmi.get_start_address());
+		if (dmi.get_end_address() > size)
+			dmi.set_end_address(e->end);
+		else
+			dmi.set_end_address(e->begin + dmi.get_end_address());
+		return granted;
+	}
+
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end) {
+		for (size_t i = 0; i < N; ++i) {
+			sc_dt::uint64 size =
+			    sc_dt::uint64(entries[i].end) - entries[i].begin;
+			if (start > size)
+				continue;
+			target.invalidate_direct_mem_ptr(
+			    entries[i].begin + start,
+			    entries[i].begin + std::min(end, size));
+		}
+	}
+
+	// Same as Bus::map, but the mapping must be one of the template
+	// arguments.
+	void map(compatible_socket &port, addr_t start_addr, addr_t size) {
+		for (size_t i = 0; i < N; ++i) {
+			if (bases[i] == start_addr && sizes[i] == size) {
+				sockets[i] = &port;
+				return;
+			}
+		}
+		std::cerr << name() << ": range [" << std::hex << start_addr
+		          << "-" << start_addr + size << "[ of target "
+		          << port.name() << " is not in the static address map"
+		          << std::endl;
+		abort();
+	}
+
+private:
+	static const addr_t bases[N];
+	static const addr_t sizes[N];
+
+	// Sockets given to map(), and the target modules, resolved at the
+	// end of elaboration.
+	compatible_socket *sockets[N];
+	std::tuple<typename MAPPINGS::target_type *...> modules;
+
+	struct entry {
+		addr_t begin;
+		addr_t end;
+		int port;
+	};
+	entry entries[N];
+
+	tlm::tlm_response_status unaligned(const char *what, addr_t a) {
+		std::stringstream s;
+		s << "unaligned " << what << " at 0x" << std::hex << a;
+		SC_REPORT_ERROR(name(), s.str().c_str());
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+
+	tlm::tlm_response_status no_target(addr_t a) {
+		std::cerr << name() << ": no target at address " << std::hex << a
+		          << std::endl;
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+
+	template <size_t I>
+	tlm::tlm_response_status dispatch_read(addr_t a, data_t &d,
+	                                       sc_core::sc_time &t, index<I>) {
+		if (mapping<I>::contains(a))
+			return hooks::call_read(*std::get<I>(modules),
+			                        a - mapping<I>::base, d, t);
+		return dispatch_read(a, d, t, index<I + 1>());
+	}
+
+	tlm::tlm_response_status dispatch_read(addr_t a, data_t &,
+	                                       sc_core::sc_time &, index<N>) {
+		return no_target(a);
+	}
+
+	template <size_t I>
+	tlm::tlm_response_status dispatch_write(addr_t a, data_t d,
+	                                        sc_core::sc_time &t, index<I>) {
+		if (mapping<I>::contains(a))
+			return hooks::call_write(*std::get<I>(modules),
+			                         a - mapping<I>::base, d, t);
+		return dispatch_write(a, d, t, index<I + 1>());
+	}
+
+	tlm::tlm_response_status dispatch_write(addr_t a, data_t,
+	                                        sc_core::sc_time &, index<N>) {
+		return no_target(a);
+	}
+
+	template <size_t I>
+	tlm::tlm_response_status dispatch_write_masked(addr_t a, data_t d,
+	                                               unsigned int be,
+	                                               sc_core::sc_time &t,
+	                                               index<I>) {
+		if (mapping<I>::contains(a))
+			return hooks::call_write_masked(*std::get<I>(modules),
+			                                a - mapping<I>::base, d,
+			                                be, t);
+		return dispatch_write_masked(a, d, be, t, index<I + 1>());
+	}
+
+	tlm::tlm_response_status dispatch_write_masked(addr_t a, data_t,
+	                                               unsigned int,
+	                                               sc_core::sc_time &,
+	                                               index<N>) {
+		return no_target(a);
+	}
+
+	const entry *find(addr_t a) const {
+		for (size_t i = 0; i < N; ++i)
+			if (addr_t(a - entries[i].begin) <=
+			    entries[i].end - entries[i].begin)
+				return &entries[i];
+		return NULL;
+	}
+
+	// The whole block must be mapped to the same target.
+	const entry *find_block(addr_t a, unsigned int n) {
+		if (a % sizeof(data_t)) {
+			unaligned("block access", a);
+			return NULL;
+		}
+		addr_t last = a + n * sizeof(data_t) - 1;
+		const entry *e = find(a);
+		if (!e || last < a || last > e->end) {
+			std::cerr << name() << ": no target for block at address "
+			          << std::hex << a << std::endl;
+			return NULL;
+		}
+		return e;
+	}
+
+	template <size_t I> void resolve(index<I>) {
+		typedef typename mapping<I>::target_type target_type;
+		compatible_socket *socket = sockets[I];
+		if (!socket) {
+			std::cerr << name() << ": nothing mapped at address "
+			          << std::hex << mapping<I>::base << "\n";
+			abort();
+		}
+		target_type *module =
+		    dynamic_cast<target_type *>(socket->get_parent_object());
+		if (!module) {
+			std::cerr << name() << ": target " << socket->name()
+			          << " does not have the type given in the "
+			             "address map\n";
+			abort();
+		}
+		std::get<I>(modules) = module;
+
+		entries[I].begin = mapping<I>::base;
+		entries[I].end = mapping<I>::base + (mapping<I>::size - 1);
+		entries[I].port = -1;
+		for (int i = 0; i < initiator.size(); ++i)
+			if (dynamic_cast<compatible_socket *>(initiator[i]) ==
+			    socket)
+				entries[I].port = i;
+		if (entries[I].port < 0) {
+			std::cerr << name() << ": target " << socket->name()
+			          << " is mapped but not bound to the bus\n";
+			abort();
+		}
+		resolve(index<I + 1>());
+	}
+
+	void resolve(index<N>) {
+	}
+
+	void end_of_elaboration() {
+		resolve(index<0>());
+		// every target bound to the bus must be mapped
+		for (int i = 0; i < initiator.size(); ++i) {
+			size_t j = 0;
+			while (j < N && entries[j].port != i)
+				++j;
+			if (j == N) {
+				std::cerr << name() << ": no address map "
+				                       "information available "
+				                       "for target "
+				          << dynamic_cast<compatible_socket *>(
+				                 initiator[i])->name()
+				          << "\n";
+				abort();
+			}
+		}
+		for (size_t i = 0; i < N; ++i)
+			std::cout << name() << ": range [" << std::hex
+			          << entries[i].begin << "-"
+			          << entries[i].end + 1
+			          << "[ is mapped to target '"
+			          << sockets[i]->name() << "'\n";
+	}
+};
+
+template <typename... MAPPINGS>
+const addr_t StaticBus<MAPPINGS...>::bases[N] = {MAPPINGS::base...};
+
+template <typename... MAPPINGS>
+const addr_t StaticBus<MAPPINGS...>::sizes[N] = {MAPPINGS::size...};
+}
+
+#endif
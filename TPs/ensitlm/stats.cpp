@@ -0,0 +1,163 @@
+#include "ensitlm.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace ensitlm {
+
+namespace {
+// What the dump needs of a socket, which may be destroyed by then.
+struct summary {
+	explicit summary(const socket_stats &s)
+	    : name(s.socket->name()), kind(s.socket->kind()), reads(s.reads),
+	      writes(s.writes), bytes(s.bytes), errors(s.errors), dmi(s.dmi),
+	      time_ns(s.time_ns) {
+		std::copy(s.histogram, s.histogram + socket_stats::buckets,
+		          histogram);
+	}
+
+	std::string name;
+	std::string kind;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t dmi;
+	uint64_t time_ns;
+	uint64_t histogram[socket_stats::buckets];
+};
+}
+
+static std::vector<socket_stats *> &all_stats() {
+	static std::vector<socket_stats *> v;
+	return v;
+}
+
+// The sockets destroyed before the dump (those of the modules built in
+// sc_main(), which returns before the program exits).
+static std::vector<summary> &destroyed_stats() {
+	static std::vector<summary> v;
+	return v;
+}
+
+socket_stats::socket_stats(const sc_core::sc_object *socket)
+    : socket(socket), reads(0), writes(0), bytes(0), errors(0), dmi(0),
+      time_ns(0) {
+	std::fill(histogram, histogram + buckets, 0);
+	all_stats().push_back(this);
+	if (enabled()) {
+		// The vectors are built first, to be destroyed after the
+		// dump.
+		destroyed_stats();
+		static const bool registered = atexit(dump) == 0;
+		(void)registered;
+	}
+}
+
+socket_stats::~socket_stats() {
+	std::vector<socket_stats *> &v = all_stats();
+	v.erase(std::remove(v.begin(), v.end(), this), v.end());
+	if (enabled() && reads + writes)
+		destroyed_stats().push_back(summary(*this));
+}
+
+bool socket_stats::check_enabled() {
+	const char *env = getenv("ENSITLM_STATS");
+	return env && *env && strcmp(env, "0") != 0;
+}
+
+static bool busier(const summary &a, const summary &b) {
+	if (a.time_ns != b.time_ns)
+		return a.time_ns > b.time_ns;
+	return a.reads + a.writes > b.reads + b.writes;
+}
+
+static void print_table(const std::vector<summary> &v) {
+	std::cout << "ensitlm: transactions per socket, by host time\n"
+	          << std::left << std::setw(32) << "socket" << std::right
+	          << std::setw(12) << "reads" << std::setw(12) << "writes"
+	          << std::setw(14) << "bytes" << std::setw(8) << "errors"
+	          << std::setw(12) << "dmi" << std::setw(12) << "time (ms)"
+	          << std::setw(10) << "ns/trans" << "\n";
+	for (size_t i = 0; i < v.size(); ++i) {
+		const summary &s = v[i];
+		uint64_t timed = s.reads + s.writes - s.dmi;
+		std::cout << std::left << std::setw(32) << s.name
+		          << std::right << std::setw(12) << s.reads
+		          << std::setw(12) << s.writes << std::setw(14)
+		          << s.bytes << std::setw(8) << s.errors
+		          << std::setw(12) << s.dmi << std::setw(12)
+		          << std::fixed << std::setprecision(3)
+		          << s.time_ns / 1e6 << std::setw(10)
+		          << std::setprecision(1)
+		          << (timed ? double(s.time_ns) / timed : 0.0) << "\n";
+	}
+	std::cout.unsetf(std::ios::floatfield);
+}
+
+// s as a JSON string, quotes included.
+static std::string json_string(const std::string &s) {
+	std::string r = "\"";
+	for (size_t i = 0; i < s.size(); ++i) {
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\') {
+			r += '\\';
+			r += c;
+		} else if (c < 0x20) {
+			char u[8];
+			snprintf(u, sizeof(u), "\\u%04x", c);
+			r += u;
+		} else {
+			r += c;
+		}
+	}
+	return r + '"';
+}
+
+static void write_json(std::ostream &os, const std::vector<summary> &v) {
+	os << "{\n  \"sockets\": [";
+	for (size_t i = 0; i < v.size(); ++i) {
+		const summary &s = v[i];
+		os << (i ? ",\n" : "\n") << "    {\"name\": "
+		   << json_string(s.name) << ", \"kind\": "
+		   << json_string(s.kind) << ", \"reads\": " << s.reads
+		   << ", \"writes\": " << s.writes << ", \"bytes\": "
+		   << s.bytes << ", \"errors\": " << s.errors
+		   << ", \"dmi\": " << s.dmi << ", \"time_ns\": " << s.time_ns
+		   << ", \"histogram_log2_ns\": [";
+		for (unsigned int b = 0; b < socket_stats::buckets; ++b)
+			os << (b ? ", " : "") << s.histogram[b];
+		os << "]}";
+	}
+	os << "\n  ]\n}\n";
+}
+
+void socket_stats::dump() {
+	std::vector<summary> v = destroyed_stats();
+	for (size_t i = 0; i < all_stats().size(); ++i)
+		if (all_stats()[i]->reads + all_stats()[i]->writes)
+			v.push_back(summary(*all_stats()[i]));
+	std::sort(v.begin(), v.end(), busier);
+
+	print_table(v);
+
+	const char *file = getenv("ENSITLM_STATS");
+	if (strcmp(file, "1") == 0)
+		file = "ensitlm-stats.json";
+	std::ofstream os(file);
+	if (!os) {
+		std::cerr << "ensitlm: cannot write statistics to " << file
+		          << std::endl;
+		return;
+	}
+	write_json(os, v);
+}
+}
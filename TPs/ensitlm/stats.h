@@ -0,0 +1,98 @@
+#ifndef ENSITLM_STATS_H
+#define ENSITLM_STATS_H
+
+#include "ensitlm.h"
+
+#include <time.h>
+
+namespace ensitlm {
+
+// Transaction statistics of a socket: number of reads and writes, bytes
+// transferred, error responses, and accesses done through DMI (seen by
+// the initiator socket only). The counters are always updated.
+//
+// When the environment variable ENSITLM_STATS is set (to anything but
+// 0), the host time spent in each transaction (b_transport, direct call
+// or approximately-timed transaction, not DMI) is also measured, and
+// all the statistics are dumped when the program exits, as a table on
+// the standard output and as JSON in the file named by ENSITLM_STATS
+// (ensitlm-stats.json if it is 1). Exiting comes after every
+// end_of_simulation() callback, so the dump includes the accesses done
+// there, such as the last posted writes of a Bus.
+class socket_stats {
+public:
+	// Bucket i of the histogram counts the transactions which took
+	// between 2^i and 2^(i+1) - 1 ns (bucket 0 also counts 0 ns).
+	static const unsigned int buckets = 32;
+
+	explicit socket_stats(const sc_core::sc_object *socket);
+	~socket_stats();
+
+	static bool enabled() {
+		static const bool e = check_enabled();
+		return e;
+	}
+
+	// Host time to pass to count(), 0 when not measuring.
+	static uint64_t start() {
+		return enabled() ? now() : 0;
+	}
+
+	void count(tlm::tlm_command command, unsigned int length,
+	           tlm::tlm_response_status s, uint64_t start) {
+		if (command == tlm::TLM_READ_COMMAND)
+			++reads;
+		else if (command == tlm::TLM_WRITE_COMMAND)
+			++writes;
+		bytes += length;
+		if (s != tlm::TLM_OK_RESPONSE)
+			++errors;
+		if (start) {
+			uint64_t ns = now() - start;
+			time_ns += ns;
+			++histogram[ns ? bucket(ns) : 0];
+		}
+	}
+
+	void count_dmi(tlm::tlm_command command, unsigned int length) {
+		if (command == tlm::TLM_READ_COMMAND)
+			++reads;
+		else
+			++writes;
+		bytes += length;
+		++dmi;
+	}
+
+	const sc_core::sc_object *socket;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t dmi;
+	uint64_t time_ns;
+	uint64_t histogram[buckets];
+
+private:
+	socket_stats(const socket_stats &);
+	socket_stats &operator=(const socket_stats &);
+
+	static bool check_enabled();
+
+	// Dump the statistics of all the sockets, those destroyed
+	// included (registered with atexit()).
+	static void dump();
+
+	static uint64_t now() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+	}
+
+	static unsigned int bucket(uint64_t ns) {
+		unsigned int b = 63 - __builtin_clzll(ns);
+		return b < buckets ? b : buckets - 1;
+	}
+};
+}
+
+#endif
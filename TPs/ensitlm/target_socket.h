@@ -3,25 +3,45 @@
 
 #include "ensitlm.h"
 
+#include <tlm_utils/peq_with_get.h>
+
+#include <deque>
+#include <string.h>
+
 namespace ensitlm {
 
-typedef tlm::tlm_target_socket<CHAR_BIT * sizeof(data_t),
-                               tlm::tlm_base_protocol_types> compatible_socket;
+template <unsigned int BUSWIDTH = 32>
+using basic_compatible_socket =
+    tlm::tlm_target_socket<BUSWIDTH, tlm::tlm_base_protocol_types>;
 
-template <typename MODULE, bool MULTIPORT = false>
+typedef basic_compatible_socket<> compatible_socket;
+
+template <typename MODULE, bool MULTIPORT = false,
+          unsigned int BUSWIDTH = 32>
 class target_socket
-    : public tlm::tlm_target_socket<CHAR_BIT * sizeof(data_t),
-                                    tlm::tlm_base_protocol_types,
+    : public tlm::tlm_target_socket<BUSWIDTH, tlm::tlm_base_protocol_types,
                                     MULTIPORT ? 0 : 1>,
-      public tlm::tlm_fw_transport_if<tlm::tlm_base_protocol_types> {
-	typedef tlm::tlm_target_socket<CHAR_BIT * sizeof(data_t),
-	                               tlm::tlm_base_protocol_types,
+      public tlm::tlm_fw_transport_if<tlm::tlm_base_protocol_types>,
+      public basic_direct_target<typename bus_data<BUSWIDTH>::type> {
+	typedef tlm::tlm_target_socket<BUSWIDTH, tlm::tlm_base_protocol_types,
 	                               MULTIPORT ? 0 : 1> base_type;
 	typedef tlm::tlm_fw_transport_if<tlm::tlm_base_protocol_types>
 	    fw_if_type;
+	typedef tlm::tlm_bw_transport_if<tlm::tlm_base_protocol_types>
+	    bw_if_type;
+
+public:
+	// Data of one access, BUSWIDTH bits wide.
+	typedef typename bus_data<BUSWIDTH>::type data_t;
+
+private:
+	typedef basic_direct_access<data_t> direct_access;
 
 public:
-	target_socket() : base_type(sc_core::sc_gen_unique_name(kind())) {
+	target_socket()
+	    : base_type(sc_core::sc_gen_unique_name(kind())),
+	      peq(sc_core::sc_gen_unique_name("peq")), at_thread_spawned(false),
+	      stats(this), current_initiator(-1) {
 		// check_typing() is never actually called, but should be
 		// statically reachable to force the compiler to do the
 		// typechecking.
@@ -30,7 +50,9 @@ public:
 		init();
 	}
 
-	explicit target_socket(const char *name) : base_type(name) {
+	explicit target_socket(const char *name)
+	    : base_type(name), peq(sc_core::sc_gen_unique_name("peq")),
+	      at_thread_spawned(false), stats(this), current_initiator(-1) {
 		init();
 	}
 
@@ -38,21 +60,112 @@ public:
 		return "ensitlm::target_socket";
 	}
 
-	bool get_direct_mem_ptr(tlm::tlm_generic_payload &, tlm::tlm_dmi &) {
-		std::cerr << "get_direct_mem_ptr not implemented" << std::endl;
-		abort();
+	bool get_direct_mem_ptr(tlm::tlm_generic_payload &trans,
+	                        tlm::tlm_dmi &dmi) {
+		addr_t addr = static_cast<addr_t>(trans.get_address());
+		if (module_get_direct_mem_ptr(
+		        addr, dmi, hooks::has_get_direct_mem_ptr<MODULE>()))
+			return true;
+		// Modules which do not grant DMI refuse it for the whole
+		// address range (the default for a fresh tlm_dmi).
+		dmi.allow_none();
+		return false;
 	}
 
-	unsigned int transport_dbg(tlm::tlm_generic_payload &) {
-		std::cerr << "transport_dbg not implemented" << std::endl;
-		abort();
+	// Index of the initiator (in the order of binding) which sent the
+	// access the module is processing, -1 if unknown. Only multiport
+	// sockets keep track of it, for the ensitlm initiator sockets, and
+	// it is only valid within the read/write methods of the module.
+	int initiator() const {
+		return current_initiator;
 	}
 
-	tlm::tlm_sync_enum nb_transport_fw(tlm::tlm_generic_payload &,
-	                                   tlm::tlm_phase &,
-	                                   sc_core::sc_time &) {
-		std::cerr << "nb_transport_fw not implemented" << std::endl;
-		abort();
+	// Accesses received so far (see stats.h).
+	const socket_stats &statistics() const {
+		return stats;
+	}
+
+	// Direct calls from the ensitlm initiator sockets (see
+	// direct_access.h).
+	void get_direct_access(direct_access &access,
+	                       const bw_if_type *initiator) {
+		if (MULTIPORT) {
+			entries.push_back(entry(this, index_of(initiator)));
+			access.target = &entries.back();
+		} else {
+			access.target = this;
+		}
+		access.read = &direct_read;
+		access.write = &direct_write;
+		access.write_masked = &direct_write_masked;
+		access.dmi_hint = hooks::has_get_direct_mem_ptr<MODULE>::value;
+	}
+
+	// To be called by the module when DMI pointers it granted to
+	// [start, end] become invalid: the invalidation is sent to every
+	// initiator bound to the socket.
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end) {
+		for (int i = 0; i < this->size(); ++i)
+			(*this)[i]->invalidate_direct_mem_ptr(start, end);
+	}
+
+	unsigned int transport_dbg(tlm::tlm_generic_payload &trans) {
+		addr_t addr = static_cast<addr_t>(trans.get_address());
+		unsigned char *data = trans.get_data_ptr();
+		unsigned int length = trans.get_data_length();
+
+		switch (trans.get_command()) {
+		case tlm::TLM_READ_COMMAND:
+			return module_debug_read(addr, data, length,
+			                         hooks::has_debug_read<MODULE>());
+		case tlm::TLM_WRITE_COMMAND:
+			return module_debug_write(
+			    addr, data, length, hooks::has_debug_write<MODULE>());
+		default:
+			return 0;
+		}
+	}
+
+	// Approximately-timed accesses. The request phase ends at once,
+	// so that the initiator can send the next request while this one
+	// is being processed, and the module is called by a thread of the
+	// socket, which then waits for the time the module added before
+	// sending the response: requests are served one after the other.
+	//
+	// The backward path of a multiport socket cannot be told from the
+	// transaction: such sockets (buses) complete the transaction
+	// immediately instead, annotating its duration.
+	tlm::tlm_sync_enum nb_transport_fw(tlm::tlm_generic_payload &trans,
+	                                   tlm::tlm_phase &phase,
+	                                   sc_core::sc_time &t) {
+		switch (phase) {
+		case tlm::BEGIN_REQ:
+			if (MULTIPORT) {
+				b_transport(trans, t);
+				phase = tlm::BEGIN_RESP;
+				return tlm::TLM_COMPLETED;
+			}
+			if (!at_thread_spawned) {
+				sc_core::sc_spawn([this]() { at_thread(); },
+				                  sc_core::sc_gen_unique_name(
+				                      "at_thread"));
+				at_thread_spawned = true;
+			}
+			// Payloads without a memory manager must live until the
+			// response anyway.
+			if (trans.has_mm())
+				trans.acquire();
+			peq.notify(trans, t);
+			phase = tlm::END_REQ;
+			return tlm::TLM_UPDATED;
+		case tlm::END_RESP:
+			end_resp_event.notify(t);
+			return tlm::TLM_COMPLETED;
+		default:
+			std::cerr << this->name() << ": unexpected phase "
+			          << phase << " in nb_transport_fw" << std::endl;
+			abort();
+		}
 	}
 
 private:
@@ -61,9 +174,9 @@ private:
 		             "meant for typechecking"
 		          << std::endl;
 		abort();
-		const ensitlm::data_t const_data = 12;
+		const data_t const_data = 12;
 		const ensitlm::addr_t const_addr = 42;
-		ensitlm::data_t data;
+		data_t data;
 		// Check that MODULE inherits publicly from
 		// sc_module. If You get an error on the following
 		// line, check that the first template argument
@@ -79,20 +192,240 @@ private:
 		s = m_mod->read(const_addr, data);
 		s = m_mod->write(const_addr, const_data);
 		(void)s;
+
+		// Optional methods (read_block, write_block, ...) are
+		// detected in hooks.h and are not required here.
+	}
+
+	bool module_get_direct_mem_ptr(addr_t addr, tlm::tlm_dmi &dmi,
+	                               std::true_type) {
+		return m_mod->get_direct_mem_ptr(addr, dmi);
+	}
+
+	bool module_get_direct_mem_ptr(addr_t, tlm::tlm_dmi &,
+	                               std::false_type) {
+		return false;
+	}
+
+	// Calls to the (optional) methods of the module. For blocks and
+	// debug accesses, the last arguments are the hooks:: traits of the
+	// module, selecting the overload to use.
+	tlm::tlm_response_status module_read(addr_t addr, data_t &data,
+	                                     sc_core::sc_time &t) {
+		return hooks::call_read(*m_mod, addr, data, t);
+	}
+
+	tlm::tlm_response_status module_write(addr_t addr, data_t data,
+	                                      sc_core::sc_time &t) {
+		return hooks::call_write(*m_mod, addr, data, t);
+	}
+
+	tlm::tlm_response_status module_read_block(addr_t addr, data_t *data,
+	                                           unsigned int n,
+	                                           sc_core::sc_time &t) {
+		return module_read_block(addr, data, n, t,
+		                         hooks::has_timed_read_block<MODULE, data_t>(),
+		                         hooks::has_read_block<MODULE, data_t>());
+	}
+
+	template <typename UNTIMED>
+	tlm::tlm_response_status
+	module_read_block(addr_t addr, data_t *data, unsigned int n,
+	                  sc_core::sc_time &t, std::true_type, UNTIMED) {
+		return m_mod->read_block(addr, data, n, t);
+	}
+
+	tlm::tlm_response_status
+	module_read_block(addr_t addr, data_t *data, unsigned int n,
+	                  sc_core::sc_time &, std::false_type, std::true_type) {
+		return m_mod->read_block(addr, data, n);
+	}
+
+	tlm::tlm_response_status
+	module_read_block(addr_t addr, data_t *data, unsigned int n,
+	                  sc_core::sc_time &t, std::false_type, std::false_type) {
+		for (unsigned int i = 0; i < n; ++i) {
+			tlm::tlm_response_status s =
+			    module_read(addr + i * sizeof(data_t), data[i], t);
+			if (s != tlm::TLM_OK_RESPONSE)
+				return s;
+		}
+		return tlm::TLM_OK_RESPONSE;
+	}
+
+	tlm::tlm_response_status module_write_block(addr_t addr,
+	                                            const data_t *data,
+	                                            unsigned int n,
+	                                            sc_core::sc_time &t) {
+		return module_write_block(
+		    addr, data, n, t, hooks::has_timed_write_block<MODULE, data_t>(),
+		    hooks::has_write_block<MODULE, data_t>());
+	}
+
+	template <typename UNTIMED>
+	tlm::tlm_response_status
+	module_write_block(addr_t addr, const data_t *data, unsigned int n,
+	                   sc_core::sc_time &t, std::true_type, UNTIMED) {
+		return m_mod->write_block(addr, data, n, t);
+	}
+
+	tlm::tlm_response_status
+	module_write_block(addr_t addr, const data_t *data, unsigned int n,
+	                   sc_core::sc_time &, std::false_type, std::true_type) {
+		return m_mod->write_block(addr, data, n);
+	}
+
+	tlm::tlm_response_status
+	module_write_block(addr_t addr, const data_t *data, unsigned int n,
+	                   sc_core::sc_time &t, std::false_type,
+	                   std::false_type) {
+		for (unsigned int i = 0; i < n; ++i) {
+			tlm::tlm_response_status s = module_write(
+			    addr + i * sizeof(data_t), data[i], t);
+			if (s != tlm::TLM_OK_RESPONSE)
+				return s;
+		}
+		return tlm::TLM_OK_RESPONSE;
+	}
+
+	unsigned int module_debug_read(addr_t addr, unsigned char *data,
+	                               unsigned int length, std::true_type) {
+		return m_mod->debug_read(addr, data, length);
+	}
+
+	unsigned int module_debug_read(addr_t, unsigned char *, unsigned int,
+	                               std::false_type) {
+		return 0;
+	}
+
+	unsigned int module_debug_write(addr_t addr, const unsigned char *data,
+	                                unsigned int length, std::true_type) {
+		return m_mod->debug_write(addr, data, length);
+	}
+
+	unsigned int module_debug_write(addr_t, const unsigned char *,
+	                                unsigned int, std::false_type) {
+		return 0;
+	}
+
+	tlm::tlm_response_status module_write_masked(addr_t addr, data_t data,
+	                                             unsigned int be,
+	                                             sc_core::sc_time &t) {
+		return hooks::call_write_masked(*m_mod, addr, data, be, t);
+	}
+
+	// Entry of an initiator for the direct calls of a multiport socket.
+	struct entry {
+		entry(target_socket *s, int i) : socket(s), initiator(i) {
+		}
+		target_socket *socket;
+		int initiator;
+	};
+	static target_socket *enter(void *target) {
+		if (!MULTIPORT)
+			return static_cast<target_socket *>(target);
+		entry *e = static_cast<entry *>(target);
+		e->socket->current_initiator = e->initiator;
+		return e->socket;
+	}
+
+	int index_of(const bw_if_type *initiator) {
+		for (int i = 0; i < this->size(); ++i)
+			if ((*this)[i] == initiator)
+				return i;
+		return -1;
+	}
+
+	static tlm::tlm_response_status direct_read(void *socket, addr_t addr,
+	                                            data_t &data,
+	                                            sc_core::sc_time &t) {
+		target_socket *self = enter(socket);
+		uint64_t start = socket_stats::start();
+		tlm::tlm_response_status s = self->module_read(addr, data, t);
+		self->stats.count(tlm::TLM_READ_COMMAND, sizeof(data_t), s,
+		                  start);
+		return s;
+	}
+
+	static tlm::tlm_response_status direct_write(void *socket, addr_t addr,
+	                                             data_t data,
+	                                             sc_core::sc_time &t) {
+		target_socket *self = enter(socket);
+		uint64_t start = socket_stats::start();
+		tlm::tlm_response_status s = self->module_write(addr, data, t);
+		self->stats.count(tlm::TLM_WRITE_COMMAND, sizeof(data_t), s,
+		                  start);
+		return s;
 	}
 
+	static tlm::tlm_response_status
+	direct_write_masked(void *socket, addr_t addr, data_t data,
+	                    unsigned int be, sc_core::sc_time &t) {
+		target_socket *self = enter(socket);
+		uint64_t start = socket_stats::start();
+		tlm::tlm_response_status s =
+		    self->module_write_masked(addr, data, be, t);
+		self->stats.count(tlm::TLM_WRITE_COMMAND,
+		                  __builtin_popcount(be), s, start);
+		return s;
+	}
+
+	// t is the local time offset of the initiator; the module may add
+	// the duration of the access to it.
 	void b_transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &t) {
-		(void)t;
+		uint64_t start = socket_stats::start();
+		if (MULTIPORT) {
+			origin *o = trans.get_extension<origin>();
+			current_initiator = o ? index_of(o->initiator) : -1;
+		}
+		if (trans.get_data_length() < sizeof(data_t) ||
+		    trans.get_byte_enable_ptr())
+			partial_transport(trans, t);
+		else
+			word_transport(trans, t);
+
+		// Tell the initiator it may ask for a DMI pointer instead
+		// of sending the next transaction.
+		if (hooks::has_get_direct_mem_ptr<MODULE>::value &&
+		    trans.is_response_ok())
+			trans.set_dmi_allowed(true);
+
+		stats.count(trans.get_command(), trans.get_data_length(),
+		            trans.get_response_status(), start);
+	}
+
+	// Accesses to one or several whole data_t.
+	void word_transport(tlm::tlm_generic_payload &trans,
+	                    sc_core::sc_time &t) {
 		addr_t addr = static_cast<addr_t>(trans.get_address());
-		data_t &data =
-		    *(reinterpret_cast<data_t *>(trans.get_data_ptr()));
+		unsigned int length = trans.get_data_length();
+		data_t *data = reinterpret_cast<data_t *>(trans.get_data_ptr());
+
+		// Blocks must be made of whole data_t, without streaming.
+		if (length > sizeof(data_t) &&
+		    (length % sizeof(data_t) ||
+		     trans.get_streaming_width() < length)) {
+			trans.set_response_status(
+			    tlm::TLM_BURST_ERROR_RESPONSE);
+			return;
+		}
 
 		switch (trans.get_command()) {
 		case tlm::TLM_READ_COMMAND:
-			trans.set_response_status(m_mod->read(addr, data));
+			if (length <= sizeof(data_t))
+				trans.set_response_status(
+				    module_read(addr, *data, t));
+			else
+				trans.set_response_status(module_read_block(
+				    addr, data, length / sizeof(data_t), t));
 			break;
 		case tlm::TLM_WRITE_COMMAND:
-			trans.set_response_status(m_mod->write(addr, data));
+			if (length <= sizeof(data_t))
+				trans.set_response_status(
+				    module_write(addr, *data, t));
+			else
+				trans.set_response_status(module_write_block(
+				    addr, data, length / sizeof(data_t), t));
 			break;
 		case tlm::TLM_IGNORE_COMMAND:
 			break;
@@ -102,6 +435,92 @@ private:
 		}
 	}
 
+	// Accesses to some bytes of a single data_t: shorter than a
+	// data_t (at any address within it), or with byte enables. The
+	// module sees an access to the whole data_t, with a mask for
+	// writes.
+	void partial_transport(tlm::tlm_generic_payload &trans,
+	                       sc_core::sc_time &t) {
+		addr_t addr = static_cast<addr_t>(trans.get_address());
+		unsigned int length = trans.get_data_length();
+		unsigned char *data = trans.get_data_ptr();
+		unsigned int offset = addr % sizeof(data_t);
+
+		if (length == 0 || offset + length > sizeof(data_t)) {
+			trans.set_response_status(
+			    tlm::TLM_ADDRESS_ERROR_RESPONSE);
+			return;
+		}
+
+		// Bit i of be enables byte i of the data_t.
+		const unsigned char *be_ptr = trans.get_byte_enable_ptr();
+		unsigned int be_length = trans.get_byte_enable_length();
+		unsigned int be = 0;
+		for (unsigned int i = 0; i < length; ++i)
+			if (!be_ptr || !be_length ||
+			    be_ptr[i % be_length] == tlm::TLM_BYTE_ENABLED)
+				be |= 1u << (offset + i);
+
+		addr -= offset;
+		data_t word = 0;
+		unsigned char *bytes = reinterpret_cast<unsigned char *>(&word);
+		tlm::tlm_response_status s;
+		switch (trans.get_command()) {
+		case tlm::TLM_READ_COMMAND:
+			s = module_read(addr, word, t);
+			if (s == tlm::TLM_OK_RESPONSE)
+				for (unsigned int i = 0; i < length; ++i)
+					if (be & (1u << (offset + i)))
+						data[i] = bytes[offset + i];
+			break;
+		case tlm::TLM_WRITE_COMMAND:
+			memcpy(bytes + offset, data, length);
+			s = module_write_masked(addr, word, be, t);
+			break;
+		case tlm::TLM_IGNORE_COMMAND:
+			return;
+		default:
+			s = tlm::TLM_COMMAND_ERROR_RESPONSE;
+		}
+		trans.set_response_status(s);
+	}
+
+	// Approximately-timed mode: requests waiting to be processed.
+	tlm_utils::peq_with_get<tlm::tlm_generic_payload> peq;
+	sc_core::sc_event end_resp_event;
+	bool at_thread_spawned;
+
+	// Accesses received by this socket (see stats.h), DMI excepted.
+	socket_stats stats;
+
+	// Multiport sockets: see initiator(). A deque, as the direct_access
+	// of the initiators point to the entries.
+	int current_initiator;
+	std::deque<entry> entries;
+
+	void at_thread() {
+		for (;;) {
+			tlm::tlm_generic_payload *trans;
+			while ((trans = peq.get_next_transaction())) {
+				sc_core::sc_time t = sc_core::SC_ZERO_TIME;
+				b_transport(*trans, t);
+				sc_core::wait(t);
+
+				tlm::tlm_phase phase = tlm::BEGIN_RESP;
+				sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+				tlm::tlm_sync_enum s =
+				    (*this)->nb_transport_bw(*trans, phase, delay);
+				if (s == tlm::TLM_ACCEPTED)
+					sc_core::wait(end_resp_event);
+				else if (delay != sc_core::SC_ZERO_TIME)
+					sc_core::wait(delay);
+				if (trans->has_mm())
+					trans->release();
+			}
+			sc_core::wait(peq.get_event());
+		}
+	}
+
 	void init() {
 		// we'll receive transactions ourselves ...
 		this->bind(*(static_cast<fw_if_type *>(this)));
@@ -0,0 +1,61 @@
+#ifndef ENSITLM_TRACE_FORMAT_H
+#define ENSITLM_TRACE_FORMAT_H
+
+// Format of the binary transaction traces written by ensitlm::recorder
+// (see recorder.h) and read by tools/trace-analyzer. This header does
+// not depend on SystemC, so that the tools can use it.
+//
+// A trace is a header, followed by the names of the initiators and of
+// the targets (NUL-terminated, in index order), followed by records up
+// to the end of the file. Everything is in the byte order of the host
+// which ran the simulation.
+
+#include <stdint.h>
+
+namespace ensitlm {
+namespace trace {
+
+static const char magic[8] = {'E', 'N', 'S', 'I', 'T', 'R', 'C', '1'};
+static const uint32_t version = 1;
+
+struct header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	// Duration of one unit of record::time, in femtoseconds (the time
+	// resolution of the simulation).
+	uint64_t resolution_fs;
+	uint16_t initiators;
+	uint16_t targets;
+	// Size of the names following the header, in bytes.
+	uint32_t names_size;
+};
+
+// Initiator or target index of an access whose initiator is not known,
+// or which was not mapped to any target.
+static const uint16_t none = 0xffff;
+
+struct record {
+	// Simulated time of the access, including the local time offset
+	// of the initiator.
+	uint64_t time;
+	// Data of the access (the first data word for blocks).
+	uint64_t data;
+	// Address on the bus.
+	uint32_t address;
+	uint16_t initiator;
+	uint16_t target;
+	// Bytes accessed.
+	uint16_t length;
+	// tlm_command and tlm_response_status.
+	uint8_t command;
+	int8_t status;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(header) == 32, "unexpected trace header layout");
+static_assert(sizeof(record) == 32, "unexpected trace record layout");
+}
+}
+
+#endif
@@ -0,0 +1,279 @@
+// Offline analysis of the binary transaction traces recorded by Bus and
+// FastBus (see record_to() and ensitlm/trace_format.h): prints the
+// traffic between each initiator and each target, the most accessed
+// address ranges, and the distribution of the intervals between two
+// accesses of the same initiator.
+//
+// Usage: ./trace-analyzer.x [-g granularity] [-n ranges] trace-file
+//
+// granularity is the size of the address ranges (4096 by default, a
+// power of two), and ranges the number of them to print (10).
+
+#include "trace_format.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace ensitlm;
+
+// Accesses of one initiator to one target, or to one address range.
+struct traffic {
+	traffic() : accesses(0), reads(0), writes(0), bytes(0), errors(0) {
+	}
+
+	void count(const trace::record &r) {
+		++accesses;
+		if (r.command == 0)
+			++reads;
+		else if (r.command == 1)
+			++writes;
+		bytes += r.length;
+		// TLM_OK_RESPONSE
+		if (r.status != 1)
+			++errors;
+	}
+
+	uint64_t accesses;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t bytes;
+	uint64_t errors;
+};
+
+// Bucket 0 counts the intervals shorter than 1 ns, bucket i > 0 those
+// between 2^(i-1) and 2^i - 1 ns.
+static const unsigned int buckets = 40;
+
+struct intervals {
+	intervals() : last(0), seen(false), total_ns(0), n(0) {
+		fill(histogram, histogram + buckets, 0);
+	}
+
+	void add(uint64_t time, double unit_ns) {
+		if (seen) {
+			uint64_t ns = time > last ? (time - last) * unit_ns : 0;
+			unsigned int b = ns ? 64 - __builtin_clzll(ns) : 0;
+			++histogram[min(b, buckets - 1)];
+			total_ns += ns;
+			++n;
+		}
+		last = time;
+		seen = true;
+	}
+
+	uint64_t last;
+	bool seen;
+	uint64_t total_ns;
+	uint64_t n;
+	uint64_t histogram[buckets];
+};
+
+struct trace_file {
+	trace::header header;
+	vector<string> initiators;
+	vector<string> targets;
+	FILE *file;
+};
+
+static void usage(const char *argv0) {
+	cerr << "Usage: " << argv0 << " [-g granularity] [-n ranges] trace-file"
+	     << endl;
+	exit(1);
+}
+
+static bool open_trace(const char *name, trace_file &f) {
+	f.file = fopen(name, "rb");
+	if (!f.file) {
+		cerr << name << ": cannot open" << endl;
+		return false;
+	}
+	trace::header &h = f.header;
+	if (fread(&h, sizeof(h), 1, f.file) != 1 ||
+	    memcmp(h.magic, trace::magic, sizeof(h.magic)) != 0) {
+		cerr << name << ": not an ensitlm trace" << endl;
+		return false;
+	}
+	if (h.version != trace::version ||
+	    h.record_size != sizeof(trace::record)) {
+		cerr << name << ": unsupported trace version " << h.version
+		     << endl;
+		return false;
+	}
+	vector<char> names(h.names_size);
+	if (fread(names.data(), 1, names.size(), f.file) != names.size()) {
+		cerr << name << ": truncated trace" << endl;
+		return false;
+	}
+	size_t pos = 0;
+	for (unsigned int i = 0; i < h.initiators + h.targets; ++i) {
+		if (pos >= names.size()) {
+			cerr << name << ": truncated names" << endl;
+			return false;
+		}
+		string s(&names[pos]);
+		pos += s.size() + 1;
+		(i < h.initiators ? f.initiators : f.targets).push_back(s);
+	}
+	// Unknown initiators and unmapped addresses get their own row and
+	// column.
+	f.initiators.push_back("(unknown)");
+	f.targets.push_back("(unmapped)");
+	return true;
+}
+
+static unsigned int index(uint16_t i, const vector<string> &names) {
+	return i < names.size() - 1 ? i : names.size() - 1;
+}
+
+static void print_matrix(const trace_file &f,
+                         const vector<vector<traffic> > &matrix,
+                         const char *what, uint64_t traffic::*field) {
+	cout << "\n" << what << " (initiator x target)\n";
+	vector<bool> row(f.initiators.size()), column(f.targets.size());
+	for (size_t i = 0; i < f.initiators.size(); ++i)
+		for (size_t j = 0; j < f.targets.size(); ++j)
+			if (matrix[i][j].accesses) {
+				row[i] = true;
+				column[j] = true;
+			}
+
+	cout << setw(24) << "";
+	for (size_t j = 0; j < f.targets.size(); ++j)
+		if (column[j])
+			cout << setw(20) << f.targets[j].substr(0, 19);
+	cout << "\n";
+	for (size_t i = 0; i < f.initiators.size(); ++i) {
+		if (!row[i])
+			continue;
+		cout << left << setw(24) << f.initiators[i].substr(0, 23)
+		     << right;
+		for (size_t j = 0; j < f.targets.size(); ++j)
+			if (column[j])
+				cout << setw(20) << matrix[i][j].*field;
+		cout << "\n";
+	}
+}
+
+static bool more_accesses(const pair<uint64_t, traffic> &a,
+                          const pair<uint64_t, traffic> &b) {
+	return a.second.accesses > b.second.accesses;
+}
+
+int main(int argc, char **argv) {
+	uint64_t granularity = 4096;
+	unsigned int nb_ranges = 10;
+	int opt;
+	while ((opt = getopt(argc, argv, "g:n:")) != -1) {
+		switch (opt) {
+		case 'g':
+			granularity = strtoull(optarg, NULL, 0);
+			break;
+		case 'n':
+			nb_ranges = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !granularity ||
+	    (granularity & (granularity - 1)))
+		usage(argv[0]);
+
+	trace_file f;
+	if (!open_trace(argv[optind], f))
+		return 1;
+	double unit_ns = f.header.resolution_fs / 1e6;
+
+	vector<vector<traffic> > matrix(
+	    f.initiators.size(), vector<traffic>(f.targets.size()));
+	map<uint64_t, traffic> ranges;
+	vector<intervals> gaps(f.initiators.size());
+	uint64_t n = 0, first = 0, last = 0;
+
+	vector<trace::record> records(4096);
+	size_t got;
+	while ((got = fread(records.data(), sizeof(trace::record),
+	                    records.size(), f.file)) > 0) {
+		for (size_t k = 0; k < got; ++k) {
+			const trace::record &r = records[k];
+			unsigned int i = index(r.initiator, f.initiators);
+			unsigned int j = index(r.target, f.targets);
+			matrix[i][j].count(r);
+			ranges[r.address & ~(granularity - 1)].count(r);
+			gaps[i].add(r.time, unit_ns);
+			if (n == 0 || r.time < first)
+				first = r.time;
+			last = max(last, r.time);
+			++n;
+		}
+	}
+	fclose(f.file);
+
+	cout << fixed << setprecision(1);
+	cout << argv[optind] << ": " << n << " transactions";
+	if (n)
+		cout << " between " << first * unit_ns << " ns and "
+		     << last * unit_ns << " ns";
+	cout << "\n";
+	if (!n)
+		return 0;
+
+	print_matrix(f, matrix, "Transactions", &traffic::accesses);
+	print_matrix(f, matrix, "Bytes", &traffic::bytes);
+	uint64_t errors = 0;
+	for (size_t i = 0; i < f.initiators.size(); ++i)
+		for (size_t j = 0; j < f.targets.size(); ++j)
+			errors += matrix[i][j].errors;
+	if (errors)
+		print_matrix(f, matrix, "Error responses", &traffic::errors);
+
+	vector<pair<uint64_t, traffic> > hot(ranges.begin(), ranges.end());
+	sort(hot.begin(), hot.end(), more_accesses);
+	if (hot.size() > nb_ranges)
+		hot.resize(nb_ranges);
+	cout << "\nHot address ranges (" << granularity << " bytes)\n"
+	     << setw(24) << "range" << setw(12) << "accesses" << setw(8)
+	     << "%" << setw(12) << "reads" << setw(12) << "writes" << "\n";
+	for (size_t k = 0; k < hot.size(); ++k) {
+		const traffic &t = hot[k].second;
+		cout << hex << "  0x" << setfill('0') << setw(8) << hot[k].first
+		     << "-0x" << setw(8) << hot[k].first + granularity
+		     << setfill(' ') << dec << setw(12) << t.accesses
+		     << setw(8) << 100.0 * t.accesses / n << setw(12) << t.reads
+		     << setw(12) << t.writes << "\n";
+	}
+
+	cout << "\nIntervals between accesses of an initiator\n";
+	for (size_t i = 0; i < gaps.size(); ++i) {
+		const intervals &g = gaps[i];
+		if (!g.n)
+			continue;
+		cout << "  " << f.initiators[i] << ": " << g.n
+		     << " intervals, mean " << double(g.total_ns) / g.n
+		     << " ns\n";
+		uint64_t highest =
+		    *max_element(g.histogram, g.histogram + buckets);
+		for (unsigned int b = 0; b < buckets; ++b) {
+			if (!g.histogram[b])
+				continue;
+			if (b == 0)
+				cout << setw(28) << "< 1 ns";
+			else
+				cout << setw(12) << (1ull << (b - 1)) << " - "
+				     << setw(10) << (1ull << b) - 1 << " ns";
+			cout << setw(12) << g.histogram[b] << " "
+			     << string(40 * g.histogram[b] / highest, '#')
+			     << "\n";
+		}
+	}
+	return 0;
+}
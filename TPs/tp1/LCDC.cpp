@@ -6,6 +6,8 @@
 #include "LCDC_registermap.h"
 #include "ensitlm.h"
 
+#include <vector>
+
 using namespace std;
 using namespace sc_core;
 
@@ -209,12 +211,15 @@ void LCDC::draw() {
 // internal XImage
 void LCDC::fill_buffer() {
 	ensitlm::addr_t a = addr_register;
-	ensitlm::data_t d;
+	std::vector<ensitlm::data_t> line(kWidth / 4);
 	tlm::tlm_response_status status;
 
 	for (int y = 0; y < kHeight; y++) {
+		// read a whole line in one transaction
+		status = initiator_socket.read_block(a, &line[0], kWidth / 4);
+
 		for (int x = 0; x < kWidth / 4; x++) {
-			status = initiator_socket.read(a, d);
+			ensitlm::data_t d = line[x];
 
 			if (status != tlm::TLM_OK_RESPONSE) {
 				cerr << name() << ": error while reading "
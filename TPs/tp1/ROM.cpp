@@ -1,6 +1,8 @@
 #include "ROM.h"
 
+#include <algorithm>
 #include <iostream>
+#include <string.h>
 
 #include "ROM_content.h"
 #include "ensitlm.h"
@@ -8,7 +10,7 @@
 using namespace std;
 using namespace sc_core;
 
-ROM::ROM(sc_module_name name) : sc_module(name) {
+ROM::ROM(sc_module_name name) : sc_module(name), latency(SC_ZERO_TIME) {
 	content = testimg;
 }
 
@@ -22,6 +24,27 @@ tlm::tlm_response_status ROM::read(const ensitlm::addr_t &a,
 	return tlm::TLM_OK_RESPONSE;
 }
 
+// Debug reads copy as much of the content as possible.
+unsigned int ROM::debug_read(ensitlm::addr_t a, unsigned char *buf,
+                             unsigned int length) {
+	if (a >= sizeof(testimg))
+		return 0;
+	unsigned int n = std::min<unsigned int>(length, sizeof(testimg) - a);
+	memcpy(buf, reinterpret_cast<unsigned char *>(content) + a, n);
+	return n;
+}
+
+// The content can be read directly, but not written.
+bool ROM::get_direct_mem_ptr(ensitlm::addr_t a, tlm::tlm_dmi &dmi) {
+	(void)a;
+	dmi.set_dmi_ptr(reinterpret_cast<unsigned char *>(content));
+	dmi.set_start_address(0);
+	dmi.set_end_address(sizeof(testimg) - 1);
+	dmi.allow_read();
+	dmi.set_read_latency(latency);
+	return true;
+}
+
 ROM::~ROM() {
 	/* */
 }
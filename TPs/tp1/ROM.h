@@ -7,9 +7,18 @@ struct ROM : public sc_core::sc_module {
 	ensitlm::target_socket<ROM> socket;
 	ensitlm::data_t *content;
 
+	// duration of a read access (zero by default)
+	sc_core::sc_time latency;
+
 	tlm::tlm_response_status read(const ensitlm::addr_t &a,
 	                              ensitlm::data_t &d);
 
+	tlm::tlm_response_status read(const ensitlm::addr_t &a,
+	                              ensitlm::data_t &d, sc_core::sc_time &t) {
+		t += latency;
+		return read(a, d);
+	}
+
 	tlm::tlm_response_status write(const ensitlm::addr_t &a,
 	                               const ensitlm::data_t &d) {
 		(void)a;
@@ -17,6 +26,11 @@ struct ROM : public sc_core::sc_module {
 		abort();
 	};
 
+	unsigned int debug_read(ensitlm::addr_t a, unsigned char *buf,
+	                        unsigned int length);
+
+	bool get_direct_mem_ptr(ensitlm::addr_t a, tlm::tlm_dmi &dmi);
+
 	SC_CTOR(ROM);
 	~ROM();
 };
@@ -11,46 +11,40 @@ using namespace std;
 
 
 void generator::thread(void) {
-  ensitlm::addr_t memory_addr = LCD_START;
-	ensitlm::addr_t rom_addr = MEMORY_START + MEMORY_SIZE;
-	ensitlm::data_t data_pixels, var;
+  ensitlm::data_t data_pixels, var;
 
   // writing to the registers of the LCDC
   socket.write(LCDC_ADDR_REG, MEMORY_START);
   socket.write(LCDC_START_REG, 1);
 
   while(1) {
-    memory_addr = MEMORY_START;
-  	rom_addr = MEMORY_START + MEMORY_SIZE;
-
     socket.write(LCDC_INT_REG, 0);
 
-    for (int i = 0; i < 76800/8; i++) {
-    	// read from ROM
-    	socket.read(rom_addr, data_pixels);
+    // read the whole image from ROM
+    socket.read_block(MEMORY_START + MEMORY_SIZE, rom_pixels.data(),
+                      rom_pixels.size());
+
+    for (int i = 0; i < LCD_SIZE/8; i++) {
+    	data_pixels = rom_pixels[i];
 
     	var = 0;
     	var = var | (data_pixels & 0xF0000000);
     	var = var | ((data_pixels & 0x0F000000) >> 4);
     	var = var | ((data_pixels & 0x00F00000) >> 8);
     	var = var | ((data_pixels & 0x000F0000) >> 12);
-    	socket.write(memory_addr, var);
+    	lcd_pixels[2 * i] = var;
 
     	var = 0;
     	var = var | ((data_pixels & 0x0000F000) << 16);
     	var = var | ((data_pixels & 0x00000F00) << 12);
     	var = var | ((data_pixels & 0x000000F0) << 8);
     	var = var | ((data_pixels & 0x0000000F) << 4);
-      memory_addr += 4;
-      socket.write(memory_addr, data_pixels);
+    	lcd_pixels[2 * i + 1] = var;
+    }
 
-      memory_addr += 4;
+    // and write it to the LCD memory in one go
+    socket.write_block(LCD_START, lcd_pixels.data(), lcd_pixels.size());
 
-      if (memory_addr >= LCD_START + LCD_SIZE) {
-        memory_addr = LCD_START;
-      }
-    	rom_addr += 4;
-    }
     while (!irq_received) {
       wait(1, sc_core::SC_MS);
     }
@@ -58,7 +52,9 @@ void generator::thread(void) {
   }
 }
 
-generator::generator(sc_core::sc_module_name name) : sc_core::sc_module(name) {
+generator::generator(sc_core::sc_module_name name)
+    : sc_core::sc_module(name), rom_pixels(LCD_SIZE / 8),
+      lcd_pixels(LCD_SIZE / 4) {
 	SC_THREAD(thread);
 }
 
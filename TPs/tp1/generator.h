@@ -1,10 +1,15 @@
 #include "ensitlm.h"
 #include "bus.h"
 
+#include <vector>
+
 struct generator : sc_core::sc_module {
 	ensitlm::initiator_socket<generator> socket;
 	sc_core::sc_in<bool> display_intr_in;
 	bool irq_received;
+	// the image, read from ROM (4 bits per pixel) and written to the LCD
+	// memory (8 bits per pixel)
+	std::vector<ensitlm::data_t> rom_pixels, lcd_pixels;
 	void thread(void);
 	void irq_handler();
 	SC_CTOR(generator);
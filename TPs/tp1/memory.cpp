@@ -1,5 +1,8 @@
 #include "memory.h"
 
+#include <algorithm>
+#include <string.h>
+
 using namespace std;
 
 tlm::tlm_response_status memory::write(const ensitlm::addr_t &a,
@@ -29,6 +32,35 @@ tlm::tlm_response_status memory::read(const ensitlm::addr_t &a,
   }
 }
 
+// debug accesses: copy as many bytes as possible, without side effects
+unsigned int memory::debug_read(ensitlm::addr_t a, unsigned char *buf,
+                                unsigned int length) {
+  if (a >= (unsigned int)size)
+    return 0;
+  unsigned int n = std::min(length, size - a);
+  memcpy(buf, (unsigned char *)storage + a, n);
+  return n;
+}
+
+unsigned int memory::debug_write(ensitlm::addr_t a, const unsigned char *buf,
+                                 unsigned int length) {
+  if (a >= (unsigned int)size)
+    return 0;
+  unsigned int n = std::min(length, size - a);
+  memcpy((unsigned char *)storage + a, buf, n);
+  return n;
+}
+
+// the whole storage can be accessed directly by the initiators
+bool memory::get_direct_mem_ptr(ensitlm::addr_t a, tlm::tlm_dmi &dmi) {
+  (void)a;
+  dmi.set_dmi_ptr(reinterpret_cast<unsigned char *>(storage));
+  dmi.set_start_address(0);
+  dmi.set_end_address(size - 1);
+  dmi.allow_read_write();
+  return true;
+}
+
 memory::memory(sc_core::sc_module_name name, int memory_size)
  									: sc_core::sc_module(name) {
   // memory_size is the size of storage in Bytes
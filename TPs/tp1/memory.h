@@ -10,6 +10,13 @@ SC_MODULE(memory){
 
 	tlm::tlm_response_status read(const ensitlm::addr_t &a,
 				            ensitlm::data_t &d);
+
+	unsigned int debug_read(ensitlm::addr_t a, unsigned char *buf,
+	                        unsigned int length);
+	unsigned int debug_write(ensitlm::addr_t a, const unsigned char *buf,
+	                         unsigned int length);
+
+	bool get_direct_mem_ptr(ensitlm::addr_t a, tlm::tlm_dmi &dmi);
 	
 	// the constructor 
 	SC_HAS_PROCESS(memory);
@@ -0,0 +1,163 @@
+#include "ensitlm.h"
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+// File format (host endianness): the magic, the simulated time of the
+// checkpoint in seconds (double), the number of components (uint32_t),
+// then for each one its name (uint32_t length and characters) and its
+// state (uint64_t size and bytes).
+static const char magic[8] = {'T', 'P', '2', 'C', 'K', 'P', 'T', '1'};
+
+// Sparse memory: the index of each page written (uint32_t) followed by
+// its contents, then no_page. The last page may be partial.
+static const uint32_t no_page = 0xffffffff;
+
+const size_t checkpointable::page_size;
+
+void checkpointable::put_sparse(std::ostream &os, const void *data,
+                                size_t size) {
+	const char *p = static_cast<const char *>(data);
+	for (size_t i = 0; i * page_size < size; ++i) {
+		size_t n = std::min(page_size, size - i * page_size);
+		const char *page = p + i * page_size;
+		size_t k = 0;
+		while (k < n && page[k] == 0)
+			++k;
+		if (k == n)
+			continue;
+		put(os, uint32_t(i));
+		os.write(page, n);
+	}
+	put(os, no_page);
+}
+
+void checkpointable::get_sparse(std::istream &is, void *data, size_t size) {
+	char *p = static_cast<char *>(data);
+	memset(p, 0, size);
+	uint32_t i;
+	for (get(is, i); is && i != no_page; get(is, i)) {
+		if (i * page_size >= size) {
+			is.setstate(std::ios::failbit);
+			return;
+		}
+		is.read(p + i * page_size,
+		        std::min(page_size, size - i * page_size));
+	}
+}
+
+Checkpoint::Checkpoint(sc_core::sc_module_name name)
+    : sc_core::sc_module(name) {
+	SC_THREAD(saver);
+}
+
+void Checkpoint::add(checkpointable &c) {
+	if (!dynamic_cast<sc_core::sc_object *>(&c)) {
+		std::cerr << name() << ": components must be sc_objects"
+		          << std::endl;
+		abort();
+	}
+	components.push_back(&c);
+}
+
+void Checkpoint::save_at(const char *file, const sc_core::sc_time &t) {
+	save_file = file;
+	save_time = t;
+}
+
+void Checkpoint::saver() {
+	if (save_file.empty())
+		return;
+	wait(save_time);
+	save(save_file.c_str());
+}
+
+void Checkpoint::save(const char *file) const {
+	std::ofstream os(file, std::ios::binary);
+	os.write(magic, sizeof(magic));
+	checkpointable::put(os, sc_core::sc_time_stamp().to_seconds());
+	checkpointable::put(os, uint32_t(components.size()));
+	for (size_t i = 0; i < components.size(); ++i) {
+		std::string n =
+		    dynamic_cast<sc_core::sc_object *>(components[i])->name();
+		std::ostringstream state;
+		components[i]->save(state);
+		checkpointable::put(os, uint32_t(n.size()));
+		os.write(n.data(), n.size());
+		checkpointable::put(os, uint64_t(state.str().size()));
+		os.write(state.str().data(), state.str().size());
+	}
+	if (!os) {
+		std::cerr << name() << ": cannot write checkpoint " << file
+		          << std::endl;
+		abort();
+	}
+	std::cout << name() << ": saved checkpoint " << file << " at "
+	          << sc_core::sc_time_stamp() << std::endl;
+}
+
+bool Checkpoint::restore(const char *file) {
+	std::ifstream is(file, std::ios::binary);
+	char m[sizeof(magic)];
+	if (!is.read(m, sizeof(m)))
+		return false;
+	if (memcmp(m, magic, sizeof(m)) != 0) {
+		std::cerr << name() << ": " << file << " is not a checkpoint"
+		          << std::endl;
+		return false;
+	}
+	double seconds;
+	uint32_t n;
+	checkpointable::get(is, seconds);
+	checkpointable::get(is, n);
+	restored.clear();
+	for (uint32_t i = 0; is && i < n; ++i) {
+		uint32_t length;
+		uint64_t size;
+		checkpointable::get(is, length);
+		std::string component(length, '\0');
+		is.read(&component[0], length);
+		checkpointable::get(is, size);
+		std::string &state = restored[component];
+		state.resize(size);
+		is.read(&state[0], size);
+	}
+	if (!is) {
+		std::cerr << name() << ": " << file << " is truncated"
+		          << std::endl;
+		restored.clear();
+		return false;
+	}
+	std::cout << name() << ": restoring checkpoint " << file
+	          << " taken at " << sc_core::sc_time(seconds, sc_core::SC_SEC)
+	          << std::endl;
+	return true;
+}
+
+void Checkpoint::start_of_simulation() {
+	for (size_t i = 0; i < components.size(); ++i) {
+		const char *n =
+		    dynamic_cast<sc_core::sc_object *>(components[i])->name();
+		std::map<std::string, std::string>::const_iterator s =
+		    restored.find(n);
+		if (s == restored.end()) {
+			if (!restored.empty())
+				std::cerr << name() << ": no state for " << n
+				          << " in the checkpoint" << std::endl;
+			continue;
+		}
+		std::istringstream is(s->second);
+		components[i]->restore(is);
+		if (!is) {
+			std::cerr << name() << ": invalid state for " << n
+			          << std::endl;
+			abort();
+		}
+	}
+	restored.clear();
+}
@@ -0,0 +1,77 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "ensitlm.h"
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// State of a module which can be saved to a checkpoint and restored from
+// it. restore() reads back exactly what save() wrote, and is called after
+// the elaboration, before any process runs.
+struct checkpointable {
+	virtual ~checkpointable() {
+	}
+
+	virtual void save(std::ostream &os) const = 0;
+	virtual void restore(std::istream &is) = 0;
+
+	template <typename T> static void put(std::ostream &os, const T &v) {
+		os.write(reinterpret_cast<const char *>(&v), sizeof(v));
+	}
+
+	template <typename T> static void get(std::istream &is, T &v) {
+		is.read(reinterpret_cast<char *>(&v), sizeof(v));
+	}
+
+	// Write size bytes of memory, skipping the pages which are all
+	// zeros. get_sparse() clears these pages.
+	static void put_sparse(std::ostream &os, const void *data, size_t size);
+	static void get_sparse(std::istream &is, void *data, size_t size);
+
+	static const size_t page_size = 4096;
+};
+
+// Checkpoint of a platform: the state of all the components added, in a
+// single file, each one tagged with its name. A component missing from
+// the file keeps its state, and the file may hold components which are
+// not in the platform.
+//
+// The simulated time cannot be restored: a restored simulation starts at
+// time 0, and the timers restart their current period. A checkpoint is
+// taken between two instructions of the processors, which may however
+// run up to one quantum ahead of the other components.
+class Checkpoint : public sc_core::sc_module {
+public:
+	SC_HAS_PROCESS(Checkpoint);
+	explicit Checkpoint(sc_core::sc_module_name name);
+
+	// c must be an sc_object, whose name identifies it in the file.
+	void add(checkpointable &c);
+
+	// Save the components to file when the simulated time reaches t.
+	void save_at(const char *file, const sc_core::sc_time &t);
+
+	// Save the components to file now.
+	void save(const char *file) const;
+
+	// Read file, and restore the components from it at the start of
+	// the simulation. Returns false if the file cannot be read.
+	bool restore(const char *file);
+
+private:
+	void saver();
+	void start_of_simulation();
+
+	std::vector<checkpointable *> components;
+	std::string save_file;
+	sc_core::sc_time save_time;
+
+	// State of each component read by restore(), by name.
+	std::map<std::string, std::string> restored;
+};
+
+#endif
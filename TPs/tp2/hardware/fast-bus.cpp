@@ -1,47 +1,241 @@
 #include "ensitlm.h"
 #include "fast-bus.h"
 
+#include <algorithm>
+
 using namespace std;
 
-FastBus::FastBus(sc_core::sc_module_name name) : sc_core::sc_module(name) {
+template <unsigned int BUSWIDTH>
+BasicFastBus<BUSWIDTH>::BasicFastBus(sc_core::sc_module_name name)
+    : sc_core::sc_module(name), in_progress(0), max_in_progress(0),
+      nb_transactions(0), b_transactions(0), trace(NULL) {
 	cout << name << ": Ensitlm fast bus" << endl;
-	target.bind(*this);
-	initiator.bind(*this);
+	target.register_b_transport(this, &BasicFastBus::b_transport);
+	target.register_nb_transport_fw(this, &BasicFastBus::nb_transport_fw);
+	target.register_get_direct_mem_ptr(this,
+	                                   &BasicFastBus::get_direct_mem_ptr);
+	target.register_transport_dbg(this, &BasicFastBus::transport_dbg);
+	initiator.register_nb_transport_bw(this,
+	                                   &BasicFastBus::nb_transport_bw);
+	initiator.register_invalidate_direct_mem_ptr(
+	    this, &BasicFastBus::invalidate_direct_mem_ptr);
+}
+
+template <unsigned int BUSWIDTH> BasicFastBus<BUSWIDTH>::~BasicFastBus() {
+	delete trace;
 }
 
-void FastBus::map(ensitlm::compatible_socket &port, ensitlm::addr_t start_addr,
-                  ensitlm::addr_t size) {
-	port_map.insert(std::pair<ensitlm::compatible_socket *, addr_range>(
+template <unsigned int BUSWIDTH>
+void BasicFastBus<BUSWIDTH>::record_to(const char *file) {
+	trace_file = file;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicFastBus<BUSWIDTH>::map(compatible_socket &port,
+                                 ensitlm::addr_t start_addr,
+                                 ensitlm::addr_t size) {
+	port_map.insert(std::pair<compatible_socket *, addr_range>(
 	    &port, addr_range(start_addr, start_addr + size - 1)));
 }
 
-void FastBus::b_transport(tlm::tlm_generic_payload &trans,
-                          sc_core::sc_time &t) {
+template <unsigned int BUSWIDTH>
+void BasicFastBus<BUSWIDTH>::b_transport(int id,
+                                         tlm::tlm_generic_payload &trans,
+                                         sc_core::sc_time &t) {
 	ensitlm::addr_t a = trans.get_address();
-	addr_map_t::iterator it = addr_map.find(addr_range(a, a));
-	if (it == addr_map.end()) {
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!range) {
 		std::cerr << name() << ": no target at address "
 		          << std::showbase << std::hex << a << std::endl;
 		trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
+		if (trace)
+			trace->record(t, id, -1, a, trans);
 		return;
 	}
-	trans.set_address(a - (*it).first.begin);
-	initiator[(*it).second]->b_transport(trans, t);
+	trans.set_address(a - range->begin);
+	sc_core::sc_time before = t;
+	initiator[range->port]->b_transport(trans, t);
+	++b_transactions;
+	busy_time += t - before;
+	if (trace)
+		trace->record(t, id, range->port, a, trans);
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_sync_enum
+BasicFastBus<BUSWIDTH>::nb_transport_fw(int id, tlm::tlm_generic_payload &trans,
+                                        tlm::tlm_phase &phase,
+                                        sc_core::sc_time &t) {
+	if (phase != tlm::BEGIN_REQ) {
+		// END_RESP (or an extension phase) for a transaction
+		// already routed.
+		typename pending_map_t::iterator it =
+		    find_pending(trans, phase);
+		tlm::tlm_sync_enum s = initiator[(*it).second.target]
+		                           ->nb_transport_fw(trans, phase, t);
+		if (phase == tlm::END_RESP || s == tlm::TLM_COMPLETED)
+			pending_map.erase(it);
+		return s;
+	}
+
+	ensitlm::addr_t a = trans.get_address();
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!range) {
+		std::cerr << name() << ": no target at address "
+		          << std::showbase << std::hex << a << std::endl;
+		trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
+		if (trace)
+			trace->record(t, id, -1, a, trans);
+		return tlm::TLM_COMPLETED;
+	}
+
+	pending p = {id, range->port, a, false};
+	typename pending_map_t::iterator it =
+	    pending_map.insert(std::make_pair(&trans, p)).first;
+	if (in_progress++ == 0)
+		busy_since = sc_core::sc_time_stamp() + t;
+	max_in_progress = std::max(max_in_progress, in_progress);
+	++nb_transactions;
+
+	trans.set_address(a - range->begin);
+	tlm::tlm_sync_enum s =
+	    initiator[range->port]->nb_transport_fw(trans, phase, t);
+	if (s == tlm::TLM_COMPLETED) {
+		response(it, t);
+		pending_map.erase(it);
+	} else if (s == tlm::TLM_UPDATED && phase == tlm::BEGIN_RESP) {
+		// END_RESP will follow on the forward path.
+		response(it, t);
+	}
+	return s;
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_sync_enum
+BasicFastBus<BUSWIDTH>::nb_transport_bw(int, tlm::tlm_generic_payload &trans,
+                                        tlm::tlm_phase &phase,
+                                        sc_core::sc_time &t) {
+	typename pending_map_t::iterator it = find_pending(trans, phase);
+	if (phase == tlm::BEGIN_RESP)
+		response(it, t);
+	tlm::tlm_sync_enum s = target[(*it).second.initiator]
+	                           ->nb_transport_bw(trans, phase, t);
+	if (s == tlm::TLM_COMPLETED ||
+	    (s == tlm::TLM_UPDATED && phase == tlm::END_RESP))
+		pending_map.erase(it);
+	return s;
+}
+
+template <unsigned int BUSWIDTH>
+typename BasicFastBus<BUSWIDTH>::pending_map_t::iterator
+BasicFastBus<BUSWIDTH>::find_pending(tlm::tlm_generic_payload &trans,
+                                     const tlm::tlm_phase &phase) {
+	typename pending_map_t::iterator it = pending_map.find(&trans);
+	if (it == pending_map.end()) {
+		std::cerr << name() << ": phase " << phase
+		          << " for an unknown transaction" << std::endl;
+		abort();
+	}
+	return it;
 }
 
-void FastBus::end_of_elaboration() {
+template <unsigned int BUSWIDTH>
+void BasicFastBus<BUSWIDTH>::response(typename pending_map_t::iterator it,
+                                      const sc_core::sc_time &t) {
+	if ((*it).second.responded)
+		return;
+	(*it).second.responded = true;
+	(*it).first->set_address((*it).second.address);
+	if (--in_progress == 0)
+		busy_time += sc_core::sc_time_stamp() + t - busy_since;
+	if (trace)
+		trace->record(t, (*it).second.initiator, (*it).second.target,
+		              (*it).second.address, *(*it).first);
+}
+
+template <unsigned int BUSWIDTH>
+unsigned int
+BasicFastBus<BUSWIDTH>::transport_dbg(int, tlm::tlm_generic_payload &trans) {
+	ensitlm::addr_t a = trans.get_address();
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!range)
+		return 0;
+	unsigned int length = trans.get_data_length();
+	unsigned int n = std::min<sc_dt::uint64>(
+	    length, sc_dt::uint64(range->end) - a + 1);
+	trans.set_address(a - range->begin);
+	trans.set_data_length(n);
+	unsigned int r = initiator[range->port]->transport_dbg(trans);
+	trans.set_address(a);
+	trans.set_data_length(length);
+	return r;
+}
+
+template <unsigned int BUSWIDTH>
+bool BasicFastBus<BUSWIDTH>::get_direct_mem_ptr(int,
+                                                tlm::tlm_generic_payload &trans,
+                                                tlm::tlm_dmi &dmi) {
+	ensitlm::addr_t a = trans.get_address();
+	const ensitlm::addr_decoder::range *range = addr_map.find(a);
+	if (!trace_file.empty() && range) {
+		// Recording: the initiators must not bypass the bus.
+		dmi.allow_none();
+		dmi.set_start_address(range->begin);
+		dmi.set_end_address(range->end);
+		return false;
+	}
+	if (!range) {
+		dmi.allow_none();
+		dmi.set_start_address(a);
+		dmi.set_end_address(a);
+		return false;
+	}
+	trans.set_address(a - range->begin);
+	bool granted = initiator[range->port]->get_direct_mem_ptr(trans, dmi);
+	trans.set_address(a);
+
+	sc_dt::uint64 size = sc_dt::uint64(range->end) - range->begin;
+	dmi.set_start_address(range->begin + dmi.get_start_address());
+	if (dmi.get_end_address() > size)
+		dmi.set_end_address(range->end);
+	else
+		dmi.set_end_address(range->begin + dmi.get_end_address());
+	return granted;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicFastBus<BUSWIDTH>::invalidate_direct_mem_ptr(int id,
+                                                       sc_dt::uint64 start,
+                                                       sc_dt::uint64 end) {
+	for (ensitlm::addr_decoder::const_iterator i = addr_map.begin();
+	     i != addr_map.end(); ++i) {
+		if ((*i).port != id)
+			continue;
+		sc_dt::uint64 size = sc_dt::uint64((*i).end) - (*i).begin;
+		if (start > size)
+			continue;
+		for (unsigned int j = 0; j < target.size(); ++j)
+			target[j]->invalidate_direct_mem_ptr(
+			    (*i).begin + start,
+			    (*i).begin + std::min(end, size));
+	}
+}
+
+template <unsigned int BUSWIDTH>
+void BasicFastBus<BUSWIDTH>::end_of_elaboration() {
 	// for each target connected to this bus initiator port
-	for (int i = 0; i < initiator.size(); ++i) {
+	for (unsigned int i = 0; i < initiator.size(); ++i) {
 		// get the target
-		ensitlm::compatible_socket *target =
-		    dynamic_cast<ensitlm::compatible_socket *>(initiator[i]);
+		compatible_socket *target =
+		    dynamic_cast<compatible_socket *>(initiator[i]);
 		if (!target) {
 			std::cerr << name()
 			          << ": target is not a tlm_target_socket\n";
 			abort();
 		}
 		// get the set of port maps which correspond to this name
-		std::pair<port_map_t::iterator, port_map_t::iterator> it =
+		std::pair<typename port_map_t::iterator,
+	          typename port_map_t::iterator> it =
 		    port_map.equal_range(target);
 		// if no port map corresponds
 		if (it.first == it.second) {
@@ -51,15 +245,14 @@ void FastBus::end_of_elaboration() {
 			abort();
 		}
 		// iterate through port maps
-		for (port_map_t::iterator j = it.first; j != it.second; ++j) {
-			std::pair<addr_range, int> map_entry((*j).second, i);
+		for (typename port_map_t::iterator j = it.first;
+		     j != it.second; ++j) {
 			// add to address map and check for conflicts
-			if (!addr_map.insert(map_entry).second) {
-				std::pair<addr_range, int> map_entry_bis =
-				    (*addr_map.find((*j).second));
-				int k = map_entry_bis.second;
-				ensitlm::compatible_socket *target_bis =
-				    dynamic_cast<ensitlm::compatible_socket *>(
+			int k = addr_map.add((*j).second.begin,
+			                     (*j).second.end, i);
+			if (k >= 0) {
+				compatible_socket *target_bis =
+				    dynamic_cast<compatible_socket *>(
 				        initiator[k]);
 				std::cerr << name() << ": address map conflict "
 				                       "between target ports "
@@ -69,19 +262,51 @@ void FastBus::end_of_elaboration() {
 			}
 		}
 	}
+	addr_map.build();
 	//   #ifdef DEBUG
 	print_addr_map();
 	//   #endif
+
+	if (!trace_file.empty()) {
+		std::vector<std::string> initiators, targets;
+		for (unsigned int i = 0; i < target.size(); ++i)
+			initiators.push_back(ensitlm::recorder::name_of(
+			    target[i], "initiator", i));
+		for (unsigned int i = 0; i < initiator.size(); ++i)
+			targets.push_back(ensitlm::recorder::name_of(
+			    initiator[i], "target", i));
+		trace = new ensitlm::recorder(trace_file.c_str(), initiators,
+		                              targets);
+	}
 }
 
-void FastBus::print_addr_map() {
+template <unsigned int BUSWIDTH>
+void BasicFastBus<BUSWIDTH>::print_addr_map() {
 	// iterate through port maps
-	for (addr_map_t::iterator i = addr_map.begin(); i != addr_map.end();
-	     ++i) {
-		std::cout << name() << ": range [" << std::hex
-		          << (*i).first.begin << "-" << (*i).first.end + 1
-		          << "[ is mapped to target '"
-		          << dynamic_cast<ensitlm::compatible_socket *>(
-		                 initiator[((*i).second)])->name() << "'\n";
+	for (ensitlm::addr_decoder::const_iterator i = addr_map.begin();
+	     i != addr_map.end(); ++i) {
+		std::cout << name() << ": range [" << std::hex << (*i).begin
+		          << "-" << (*i).end + 1 << "[ is mapped to target '"
+		          << dynamic_cast<compatible_socket *>(
+		                 initiator[(*i).port])->name() << "'\n";
 	}
 }
+
+template <unsigned int BUSWIDTH>
+void BasicFastBus<BUSWIDTH>::end_of_simulation() {
+	sc_core::sc_time now = sc_core::sc_time_stamp();
+	std::cout << name() << ": " << std::dec << b_transactions
+	          << " blocking and " << nb_transactions
+	          << " non-blocking transactions (at most "
+	          << max_in_progress
+	          << " in progress), busy for " << busy_time;
+	if (now != sc_core::SC_ZERO_TIME)
+		std::cout << " (" << 100 * (busy_time / now) << "%)";
+	std::cout << std::endl;
+
+	delete trace;
+	trace = NULL;
+}
+
+template struct BasicFastBus<32>;
+template struct BasicFastBus<64>;
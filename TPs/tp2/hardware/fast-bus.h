@@ -2,8 +2,14 @@
 #define FAST_BUS_H
 
 #include "ensitlm.h"
+#include "addr_decoder.h"
+#include "recorder.h"
+
+#include <tlm_utils/multi_passthrough_initiator_socket.h>
+#include <tlm_utils/multi_passthrough_target_socket.h>
 
 #include <map>
+#include <string>
 
 // Alternative implementation for the bus. Instead of relying on
 // ensitlm's read and write functions, we use the raw initiator/target
@@ -12,56 +18,99 @@
 // This does less work than the Bus implementation, but the
 // performance gain is not visible in practice (it can even be
 // slower).
-SC_MODULE(FastBus), tlm::tlm_fw_transport_if<tlm::tlm_base_protocol_types>,
-    tlm::tlm_bw_transport_if<tlm::tlm_base_protocol_types> {
-
-	tlm::tlm_target_socket<CHAR_BIT * sizeof(ensitlm::data_t),
-	                       tlm::tlm_base_protocol_types, 0> target;
-	tlm::tlm_initiator_socket<CHAR_BIT * sizeof(ensitlm::data_t),
-	                          tlm::tlm_base_protocol_types, 0> initiator;
-
-	FastBus(sc_core::sc_module_name name);
-
-	void map(ensitlm::compatible_socket & port, ensitlm::addr_t start_addr,
+//
+// Unlike Bus, FastBus also forwards the phases of approximately-timed
+// transactions (nb_transport) in both directions, so that the
+// initiators can pipeline their requests up to the targets. The
+// utilisation of the bus is printed at the end of the simulation.
+//
+// The methods are defined in fast-bus.cpp, for 32 and 64-bit buses.
+template <unsigned int BUSWIDTH = 32>
+struct BasicFastBus : sc_core::sc_module {
+	typedef ensitlm::basic_compatible_socket<BUSWIDTH> compatible_socket;
+
+	tlm_utils::multi_passthrough_target_socket<BasicFastBus, BUSWIDTH>
+	    target;
+	tlm_utils::multi_passthrough_initiator_socket<BasicFastBus, BUSWIDTH>
+	    initiator;
+
+	BasicFastBus(sc_core::sc_module_name name);
+	~BasicFastBus();
+
+	void map(compatible_socket & port, ensitlm::addr_t start_addr,
 	         ensitlm::addr_t size);
 
+	// Record every transaction (debug ones excepted) into a binary
+	// trace, as Bus::record_to(). Approximately-timed transactions are
+	// recorded when their response goes back to the initiator.
+	void record_to(const char *file);
+
 	// Function that does the job of transporting the payload.
-	void b_transport(tlm::tlm_generic_payload & trans,
+	void b_transport(int id, tlm::tlm_generic_payload & trans,
 	                 sc_core::sc_time & t);
 
-	// Default implementation of methods to be able to derive from
-	// tlm_fw_transport_if and tlm_bw_transport_if.
-	bool get_direct_mem_ptr(tlm::tlm_generic_payload &, tlm::tlm_dmi &) {
-		std::cerr << "get_direct_mem_ptr not implemented" << std::endl;
-		abort();
-	}
-
-	unsigned int transport_dbg(tlm::tlm_generic_payload &) {
-		std::cerr << "transport_dbg not implemented" << std::endl;
-		abort();
-	}
-
-	tlm::tlm_sync_enum nb_transport_fw(
-	    tlm::tlm_generic_payload &, tlm::tlm_phase &, sc_core::sc_time &) {
-		std::cerr << "nb_transport_fw not implemented" << std::endl;
-		abort();
-	}
-
-	void invalidate_direct_mem_ptr(sc_dt::uint64, sc_dt::uint64) {
-		std::cerr << "invalidate_direct_mem_ptr not implemented"
-		          << std::endl;
-		abort();
-	}
-
-	tlm::tlm_sync_enum nb_transport_bw(
-	    tlm::tlm_generic_payload &, tlm::tlm_phase &, sc_core::sc_time &) {
-		std::cerr << "nb_transport_bw not implemented" << std::endl;
-		abort();
-	}
+	// Approximately-timed transactions: the address is translated
+	// while the transaction is in the target, and restored when the
+	// response goes back to the initiator it came from.
+	tlm::tlm_sync_enum nb_transport_fw(int id,
+	                                   tlm::tlm_generic_payload & trans,
+	                                   tlm::tlm_phase & phase,
+	                                   sc_core::sc_time & t);
+	tlm::tlm_sync_enum nb_transport_bw(int id,
+	                                   tlm::tlm_generic_payload & trans,
+	                                   tlm::tlm_phase & phase,
+	                                   sc_core::sc_time & t);
+
+	// DMI requests are forwarded to the target, and the region it
+	// returns is translated back to the bus address space.
+	bool get_direct_mem_ptr(int id, tlm::tlm_generic_payload & trans,
+	                        tlm::tlm_dmi & dmi);
+
+	// Debug transactions are forwarded like b_transport, but clipped
+	// to the range of the target decoding the first address.
+	unsigned int transport_dbg(int id, tlm::tlm_generic_payload & trans);
+
+	// Invalidations from a target are translated for each of its
+	// ranges and forwarded to all initiators.
+	void invalidate_direct_mem_ptr(int id, sc_dt::uint64 start,
+	                               sc_dt::uint64 end);
 
 private:
 	void print_addr_map();
 	void end_of_elaboration();
+	void end_of_simulation();
+
+	// Approximately-timed transactions routed through the bus, until
+	// their last phase.
+	struct pending {
+		int initiator;           // target socket id it came from
+		int target;              // initiator socket id it went to
+		ensitlm::addr_t address; // before translation
+		bool responded;
+	};
+	typedef std::map<tlm::tlm_generic_payload *, pending> pending_map_t;
+	pending_map_t pending_map;
+
+	typename pending_map_t::iterator
+	find_pending(tlm::tlm_generic_payload & trans,
+	             const tlm::tlm_phase &phase);
+
+	// The response goes back to the initiator t after now.
+	void response(typename pending_map_t::iterator it,
+	              const sc_core::sc_time &t);
+
+	// Utilisation: the bus is busy while at least one approximately-
+	// timed transaction waits for its response, or for the duration
+	// annotated by the targets of blocking ones.
+	unsigned int in_progress;
+	unsigned int max_in_progress;
+	unsigned long nb_transactions;
+	unsigned long b_transactions;
+	sc_core::sc_time busy_since;
+	sc_core::sc_time busy_time;
+
+	std::string trace_file;
+	ensitlm::recorder *trace;
 
 	class addr_range {
 	public:
@@ -75,12 +124,16 @@ private:
 		}
 	};
 
-	typedef std::multimap<ensitlm::compatible_socket *, addr_range>
-	    port_map_t;
+	typedef std::multimap<compatible_socket *, addr_range> port_map_t;
 	port_map_t port_map;
 
-	typedef std::map<addr_range, int> addr_map_t;
-	addr_map_t addr_map;
+	// Built from port_map at the end of elaboration.
+	ensitlm::addr_decoder addr_map;
 };
 
+extern template struct BasicFastBus<32>;
+extern template struct BasicFastBus<64>;
+
+typedef BasicFastBus<> FastBus;
+
 #endif
@@ -58,3 +58,13 @@ tlm::tlm_response_status Gpio::write(const ensitlm::addr_t &a,
 	}
 	return tlm::TLM_OK_RESPONSE;
 }
+
+void Gpio::save(std::ostream &os) const {
+	put(os, data);
+	put(os, tri);
+}
+
+void Gpio::restore(std::istream &is) {
+	get(is, data);
+	get(is, tri);
+}
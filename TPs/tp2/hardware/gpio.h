@@ -2,8 +2,9 @@
 #define GPIO_H
 
 #include "ensitlm.h"
+#include "checkpoint.h"
 
-SC_MODULE(Gpio) {
+struct Gpio : sc_core::sc_module, checkpointable {
 
 	ensitlm::target_socket<Gpio> target;
 
@@ -15,6 +16,10 @@ SC_MODULE(Gpio) {
 	tlm::tlm_response_status write(const ensitlm::addr_t &a,
 	                               const ensitlm::data_t &d);
 
+	// The data and direction registers (the buttons are read live).
+	void save(std::ostream &os) const;
+	void restore(std::istream &is);
+
 private:
 	ensitlm::data_t data;
 	ensitlm::data_t tri;
@@ -165,3 +165,13 @@ tlm::tlm_response_status Intc::write(ensitlm::addr_t a, ensitlm::data_t d) {
 	}
 	return tlm::TLM_OK_RESPONSE;
 }
+
+void Intc::save(std::ostream &os) const {
+	put(os, m_enabled_it);
+	put(os, m_active_it);
+}
+
+void Intc::restore(std::istream &is) {
+	get(is, m_enabled_it);
+	get(is, m_active_it);
+}
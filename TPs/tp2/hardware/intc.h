@@ -2,10 +2,11 @@
 #define INTC_H
 
 #include "ensitlm.h"
+#include "checkpoint.h"
 
 #include <vector>
 
-SC_MODULE(Intc) {
+struct Intc : sc_core::sc_module, checkpointable {
 	ensitlm::target_socket<Intc> target;
 
 	SC_HAS_PROCESS(Intc);
@@ -20,6 +21,10 @@ SC_MODULE(Intc) {
 
 	tlm::tlm_response_status write(ensitlm::addr_t a, ensitlm::data_t d);
 
+	// The enabled and active interrupts.
+	void save(std::ostream &os) const;
+	void restore(std::istream &is);
+
 private:
 	void process_in_irq(int N);
 	void process_in_irq0() {
@@ -1,30 +1,38 @@
 #include "ensitlm.h"
 #include "memory.h"
 
+#include <algorithm>
+#include <string.h>
+
 #if 0
 #define DEBUG
 #endif
 
 // Constructor
-Memory::Memory(sc_core::sc_module_name name, unsigned int size)
-    : sc_module(name), m_size(size) {
-	storage = new ensitlm::data_t[size / sizeof(ensitlm::data_t)];
+template <unsigned int BUSWIDTH>
+BasicMemory<BUSWIDTH>::BasicMemory(sc_core::sc_module_name name,
+                                   unsigned int size,
+                                   const sc_core::sc_time &latency)
+    : sc_module(name), m_size(size), m_latency(latency) {
+	storage = new data_t[size / sizeof(data_t)];
 }
 
 // Destructor
-Memory::~Memory() {
+template <unsigned int BUSWIDTH> BasicMemory<BUSWIDTH>::~BasicMemory() {
 	delete[] storage;
 }
 
 // Read transactions
-tlm::tlm_response_status Memory::read(ensitlm::addr_t a, ensitlm::data_t &d) {
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicMemory<BUSWIDTH>::read(ensitlm::addr_t a,
+                                                     data_t &d) {
 	// Check if the address is within memory bounds
 	if (a >= m_size) {
 		std::cerr << name() << ": Read access outside memory range! ("
 		          << a << ")" << std::endl;
 		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
 	} else {
-		d = storage[a / sizeof(ensitlm::data_t)];
+		d = storage[a / sizeof(data_t)];
 #ifdef DEBUG
 		std::cout << name() << ": Read  access at " << std::showbase
 		       << std::hex << a << " (Data: " << std::showbase << d << ")" << std::endl;
@@ -34,7 +42,9 @@ tlm::tlm_response_status Memory::read(ensitlm::addr_t a, ensitlm::data_t &d) {
 }
 
 // Write transactions
-tlm::tlm_response_status Memory::write(ensitlm::addr_t a, ensitlm::data_t d) {
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicMemory<BUSWIDTH>::write(ensitlm::addr_t a,
+                                                      data_t d) {
 	// Check if the address is within memory bounds
 	if (a >= m_size) {
 		std::cerr << name() << ": Write access outside memory range! ("
@@ -45,7 +55,135 @@ tlm::tlm_response_status Memory::write(ensitlm::addr_t a, ensitlm::data_t d) {
 		std::cout << name() << ": Write access at " << std::showbase
 		          << std::hex << a << " (Data: " << std::showbase << d << ")" << std::endl;
 #endif
-		storage[a / sizeof(ensitlm::data_t)] = d;
+		storage[a / sizeof(data_t)] = d;
 		return tlm::TLM_OK_RESPONSE;
 	}
 }
+
+// Timed transactions: same as above, but report the latency
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicMemory<BUSWIDTH>::read(ensitlm::addr_t a,
+                                                     data_t &d,
+                                                     sc_core::sc_time &t) {
+	t += m_latency;
+	return read(a, d);
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status BasicMemory<BUSWIDTH>::write(ensitlm::addr_t a,
+                                                      data_t d,
+                                                      sc_core::sc_time &t) {
+	t += m_latency;
+	return write(a, d);
+}
+
+// Partial writes: only the bytes enabled in be are modified
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status
+BasicMemory<BUSWIDTH>::write_masked(ensitlm::addr_t a, data_t d,
+                                    unsigned int be, sc_core::sc_time &t) {
+	if (a >= m_size) {
+		std::cerr << name() << ": Write access outside memory range! ("
+		          << a << ")" << std::endl;
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+	unsigned char *dst =
+	    reinterpret_cast<unsigned char *>(&storage[a / sizeof(d)]);
+	const unsigned char *src = reinterpret_cast<const unsigned char *>(&d);
+	for (unsigned int i = 0; i < sizeof(d); ++i)
+		if (be & (1u << i))
+			dst[i] = src[i];
+	t += m_latency;
+	return tlm::TLM_OK_RESPONSE;
+}
+
+// Block transactions
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status
+BasicMemory<BUSWIDTH>::read_block(ensitlm::addr_t a, data_t *d, unsigned int n,
+                                  sc_core::sc_time &t) {
+	unsigned int length = n * sizeof(data_t);
+	if (a >= m_size || length > m_size - a) {
+		std::cerr << name() << ": Block read outside memory range! ("
+		          << a << ")" << std::endl;
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+	memcpy(d, &storage[a / sizeof(data_t)], length);
+	t += m_latency * n;
+	return tlm::TLM_OK_RESPONSE;
+}
+
+template <unsigned int BUSWIDTH>
+tlm::tlm_response_status
+BasicMemory<BUSWIDTH>::write_block(ensitlm::addr_t a, const data_t *d,
+                                   unsigned int n, sc_core::sc_time &t) {
+	unsigned int length = n * sizeof(data_t);
+	if (a >= m_size || length > m_size - a) {
+		std::cerr << name() << ": Block write outside memory range! ("
+		          << a << ")" << std::endl;
+		return tlm::TLM_ADDRESS_ERROR_RESPONSE;
+	}
+	memcpy(&storage[a / sizeof(data_t)], d, length);
+	t += m_latency * n;
+	return tlm::TLM_OK_RESPONSE;
+}
+
+// Debug transactions: no side effect, and clipped to the memory size
+template <unsigned int BUSWIDTH>
+unsigned int BasicMemory<BUSWIDTH>::debug_read(ensitlm::addr_t a,
+                                               unsigned char *buf,
+                                               unsigned int length) {
+	if (a >= m_size)
+		return 0;
+	unsigned int n = std::min(length, m_size - a);
+	memcpy(buf, reinterpret_cast<unsigned char *>(storage) + a, n);
+	return n;
+}
+
+template <unsigned int BUSWIDTH>
+unsigned int BasicMemory<BUSWIDTH>::debug_write(ensitlm::addr_t a,
+                                                const unsigned char *buf,
+                                                unsigned int length) {
+	if (a >= m_size)
+		return 0;
+	unsigned int n = std::min(length, m_size - a);
+	memcpy(reinterpret_cast<unsigned char *>(storage) + a, buf, n);
+	return n;
+}
+
+// Direct memory access: the whole storage can be accessed by initiators
+// without going through read and write.
+template <unsigned int BUSWIDTH>
+bool BasicMemory<BUSWIDTH>::get_direct_mem_ptr(ensitlm::addr_t a,
+                                               tlm::tlm_dmi &dmi) {
+	(void)a;
+	dmi.set_dmi_ptr(reinterpret_cast<unsigned char *>(storage));
+	dmi.set_start_address(0);
+	dmi.set_end_address(m_size - 1);
+	dmi.allow_read_write();
+	dmi.set_read_latency(m_latency);
+	dmi.set_write_latency(m_latency);
+	return true;
+}
+
+template <unsigned int BUSWIDTH>
+void BasicMemory<BUSWIDTH>::save(std::ostream &os) const {
+	put(os, m_size);
+	put_sparse(os, storage, m_size);
+}
+
+template <unsigned int BUSWIDTH>
+void BasicMemory<BUSWIDTH>::restore(std::istream &is) {
+	unsigned int size;
+	get(is, size);
+	if (size != m_size) {
+		std::cerr << name() << ": checkpoint of a memory of " << size
+		          << " bytes" << std::endl;
+		is.setstate(std::ios::failbit);
+		return;
+	}
+	get_sparse(is, storage, m_size);
+}
+
+template struct BasicMemory<32>;
+template struct BasicMemory<64>;
@@ -2,24 +2,70 @@
 #define MEMORY_H
 
 #include "ensitlm.h"
+#include "checkpoint.h"
 
-SC_MODULE(Memory) {
-	ensitlm::target_socket<Memory> target;
+// Memory on a bus BUSWIDTH bits wide. The methods are defined in
+// memory.cpp, for 32 and 64-bit buses.
+template <unsigned int BUSWIDTH = 32>
+struct BasicMemory : sc_core::sc_module, checkpointable {
+	typedef typename ensitlm::bus_data<BUSWIDTH>::type data_t;
 
-	Memory(sc_core::sc_module_name name, unsigned int size);
+	ensitlm::target_socket<BasicMemory, false, BUSWIDTH> target;
 
-	~Memory();
+	// latency is the duration of the access to one data_t
+	BasicMemory(sc_core::sc_module_name name, unsigned int size,
+	            const sc_core::sc_time &latency = sc_core::SC_ZERO_TIME);
 
-	tlm::tlm_response_status read(ensitlm::addr_t a, ensitlm::data_t & d);
+	~BasicMemory();
 
-	tlm::tlm_response_status write(ensitlm::addr_t a, ensitlm::data_t d);
+	tlm::tlm_response_status read(ensitlm::addr_t a, data_t & d);
+
+	tlm::tlm_response_status write(ensitlm::addr_t a, data_t d);
+
+	tlm::tlm_response_status read(ensitlm::addr_t a, data_t & d,
+	                              sc_core::sc_time & t);
+
+	tlm::tlm_response_status write(ensitlm::addr_t a, data_t d,
+	                               sc_core::sc_time & t);
+
+	tlm::tlm_response_status write_masked(ensitlm::addr_t a,
+	                                      data_t d,
+	                                      unsigned int be,
+	                                      sc_core::sc_time &t);
+
+	tlm::tlm_response_status read_block(ensitlm::addr_t a,
+	                                    data_t * d, unsigned int n,
+	                                    sc_core::sc_time & t);
+
+	tlm::tlm_response_status write_block(ensitlm::addr_t a,
+	                                     const data_t *d,
+	                                     unsigned int n,
+	                                     sc_core::sc_time &t);
+
+	unsigned int debug_read(ensitlm::addr_t a, unsigned char *buf,
+	                        unsigned int length);
+
+	unsigned int debug_write(ensitlm::addr_t a, const unsigned char *buf,
+	                         unsigned int length);
+
+	bool get_direct_mem_ptr(ensitlm::addr_t a, tlm::tlm_dmi & dmi);
+
+	// The contents, without the pages which are all zeros.
+	void save(std::ostream &os) const;
+	void restore(std::istream &is);
 
 private:
 	unsigned int m_size;
+	sc_core::sc_time m_latency;
 
 public:
 	/* The loader must have access to the storage */
-	ensitlm::data_t *storage;
+	data_t *storage;
 };
 
+extern template struct BasicMemory<32>;
+extern template struct BasicMemory<64>;
+
+typedef BasicMemory<> Memory;
+
 #endif
@@ -0,0 +1,113 @@
+#include "ensitlm.h"
+#include "sim-speed.h"
+
+#include <iomanip>
+#include <iostream>
+
+SimSpeed::SimSpeed(sc_core::sc_module_name name, double interval,
+                   sc_core::sc_time poll)
+    : sc_core::sc_module(name), interval(interval), poll(poll), steps(0),
+      started(false), reported(false) {
+	if (interval > 0)
+		SC_METHOD(tick);
+#ifdef SC_ENABLE_SIMULATION_PHASE_CALLBACKS
+	register_simulation_phase_callback(sc_core::SC_BEFORE_TIMESTEP);
+#endif
+}
+
+SimSpeed::~SimSpeed() {
+	if (started && !reported)
+		report("total", first, now());
+}
+
+void SimSpeed::count_instructions(const uint64_t &counter) {
+	instructions.push_back(&counter);
+}
+
+void SimSpeed::count_transactions(const ensitlm::socket_stats &stats) {
+	transactions.push_back(&stats);
+}
+
+SimSpeed::sample SimSpeed::now() const {
+	sample s;
+	s.host = clock::now();
+	s.simulated = sc_core::sc_time_stamp();
+	s.instructions = 0;
+	for (size_t i = 0; i < instructions.size(); ++i)
+		s.instructions += *instructions[i];
+	s.transactions = 0;
+	for (size_t i = 0; i < transactions.size(); ++i) {
+		const ensitlm::socket_stats &t = *transactions[i];
+		s.transactions += t.reads + t.writes - t.dmi;
+	}
+	s.deltas = sc_core::sc_delta_count();
+	s.steps = steps;
+	return s;
+}
+
+void SimSpeed::report(const char *what, const sample &from,
+                      const sample &to) const {
+	double host =
+	    std::chrono::duration<double>(to.host - from.host).count();
+	double simulated = (to.simulated - from.simulated).to_seconds();
+	if (host <= 0)
+		return;
+
+	std::cout << name() << " (" << what << "): " << std::fixed
+	          << std::setprecision(6) << simulated
+	          << " s simulated in " << std::setprecision(3) << host
+	          << " s, ratio " << std::scientific << std::setprecision(3)
+	          << simulated / host << std::fixed << "\n";
+	struct {
+		const char *name;
+		bool counted;
+		uint64_t n;
+	} rows[] = {
+	    {"instructions", !instructions.empty(),
+	     to.instructions - from.instructions},
+	    {"transactions", !transactions.empty(),
+	     to.transactions - from.transactions},
+	    {"delta cycles", true, to.deltas - from.deltas},
+#ifdef SC_ENABLE_SIMULATION_PHASE_CALLBACKS
+	    {"time steps", true, to.steps - from.steps},
+#endif
+	};
+	for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); ++i) {
+		if (!rows[i].counted)
+			continue;
+		std::cout << "  " << std::left << std::setw(14) << rows[i].name
+		          << std::right << std::setw(14) << rows[i].n
+		          << std::setw(12) << std::setprecision(3)
+		          << rows[i].n / host / 1e6 << " M/s\n";
+	}
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout << std::flush;
+}
+
+void SimSpeed::start_of_simulation() {
+	first = last = now();
+	started = true;
+}
+
+void SimSpeed::end_of_simulation() {
+	report("total", first, now());
+	reported = true;
+}
+
+void SimSpeed::tick() {
+	sample s = now();
+	if (std::chrono::duration<double>(s.host - last.host).count() >=
+	    interval) {
+		report("last period", last, s);
+		last = s;
+	}
+	// Do not keep an otherwise finished simulation alive.
+	if (sc_core::sc_pending_activity())
+		next_trigger(poll);
+}
+
+#ifdef SC_ENABLE_SIMULATION_PHASE_CALLBACKS
+void SimSpeed::simulation_phase_callback() {
+	++steps;
+}
+#endif
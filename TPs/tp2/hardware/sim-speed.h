@@ -0,0 +1,77 @@
+#ifndef SIM_SPEED_H
+#define SIM_SPEED_H
+
+#include "ensitlm.h"
+
+#include <chrono>
+#include <vector>
+
+// Simulation speed report: guest instructions, interconnect transactions,
+// delta cycles and time steps per second of host time, and the ratio of
+// the simulated time to the host time.
+//
+// The report covers the whole simulation and is printed at its end. When
+// interval is not 0, the speed over the last interval seconds of host
+// time is also printed periodically: the host time is checked every
+// poll of simulated time, as long as the rest of the platform has
+// activity.
+//
+// Time steps (advances of the simulated time) are only counted when
+// SystemC is built with simulation phase callbacks
+// (--enable-phase-callbacks) and SC_ENABLE_SIMULATION_PHASE_CALLBACKS is
+// defined when compiling this file.
+//
+// Instantiate it after the modules it counts: if the simulation is not
+// stopped with sc_stop(), it prints its report when destroyed.
+SC_MODULE(SimSpeed) {
+	SC_HAS_PROCESS(SimSpeed);
+
+	SimSpeed(sc_core::sc_module_name name, double interval = 0,
+	         sc_core::sc_time poll = sc_core::sc_time(10, sc_core::SC_US));
+	~SimSpeed();
+
+	// Count the instructions executed by a processor, e.g.
+	// RV32Wrapper::retired.
+	void count_instructions(const uint64_t &counter);
+
+	// Count the accesses seen by a socket, e.g. the target socket of a
+	// Bus (DMI accesses do not go through it).
+	void count_transactions(const ensitlm::socket_stats &stats);
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	struct sample {
+		clock::time_point host;
+		sc_core::sc_time simulated;
+		uint64_t instructions;
+		uint64_t transactions;
+		uint64_t deltas;
+		uint64_t steps;
+	};
+
+	sample now() const;
+	void report(const char *what, const sample &from,
+	            const sample &to) const;
+
+	void start_of_simulation();
+	void end_of_simulation();
+	void tick();
+#ifdef SC_ENABLE_SIMULATION_PHASE_CALLBACKS
+	void simulation_phase_callback();
+#endif
+
+	double interval;
+	sc_core::sc_time poll;
+	std::vector<const uint64_t *> instructions;
+	std::vector<const ensitlm::socket_stats *> transactions;
+	uint64_t steps;
+
+	// At the start of the simulation, and of the current interval.
+	sample first;
+	sample last;
+	bool started;
+	bool reported;
+};
+
+#endif
@@ -201,3 +201,23 @@ tlm::tlm_response_status TIMER::write(ensitlm::addr_t a, ensitlm::data_t d) {
 	}
 	return tlm::TLM_OK_RESPONSE;
 }
+
+void TIMER::save(std::ostream &os) const {
+	put(os, csr);
+	put(os, tlr);
+	put(os, tcr);
+}
+
+void TIMER::restore(std::istream &is) {
+	get(is, csr);
+	get(is, tlr);
+	get(is, tcr);
+	for (int timer = 0; timer < 2; ++timer) {
+		refresh[timer] = false;
+		csr_event[timer].cancel();
+		if (TEST_BIT(csr[timer], TIMER_ENT)) {
+			refresh[timer] = true;
+			csr_event[timer].notify(sc_core::SC_ZERO_TIME);
+		}
+	}
+}
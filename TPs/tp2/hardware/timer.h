@@ -2,8 +2,9 @@
 #define TIMER_H
 
 #include "ensitlm.h"
+#include "checkpoint.h"
 
-SC_MODULE(TIMER) {
+struct TIMER : sc_core::sc_module, checkpointable {
 	SC_HAS_PROCESS(TIMER);
 
 	ensitlm::target_socket<TIMER> target;
@@ -15,6 +16,10 @@ SC_MODULE(TIMER) {
 
 	tlm::tlm_response_status write(ensitlm::addr_t a, ensitlm::data_t d);
 
+	// The registers: the enabled timers restart their current period.
+	void save(std::ostream &os) const;
+	void restore(std::istream &is);
+
 private:
 	sc_core::sc_time period;
 	sc_core::sc_event irq_event;
@@ -30,7 +30,8 @@ Uint16 black;
 Uint16 white;
 
 Vga::Vga(sc_core::sc_module_name name)
-    : sc_core::sc_module(name), address(0), intr(false)
+    : sc_core::sc_module(name), address(0), intr(false), frames(0),
+      frame(VGA_WIDTH * VGA_HEIGHT / (sizeof(ensitlm::data_t) * CHAR_BIT))
 {
 
 	SC_THREAD(thread);
@@ -92,6 +93,7 @@ void Vga::vsync()
 {
 	SDL_PumpEvents();
 	draw();
+	++frames;
 
 #ifdef DEBUG
 	std::cout << "Debug: " << sc_module::name() << ": vsync @ "
@@ -110,13 +112,18 @@ void Vga::draw()
 		SDL_LockSurface(screen);
 	}
 
+	/* Fetch the whole frame at once */
+	if (initiator.read_block(address, frame.data(), frame.size())
+	    != tlm::TLM_OK_RESPONSE) {
+		SC_REPORT_ERROR(name(), "cannot read the framebuffer");
+	}
+
 	for (int y = 0; y < VGA_HEIGHT; ++y) {
 		for (int x = 0;
 			 x < VGA_WIDTH;
 			 x += (sizeof(ensitlm::data_t) * CHAR_BIT)) {
 
-			ensitlm::data_t d;
-			initiator.read(address + ((x + (y * VGA_WIDTH)) / CHAR_BIT), d);
+			ensitlm::data_t d = frame[(x + (y * VGA_WIDTH)) / (sizeof(ensitlm::data_t) * CHAR_BIT)];
 
 			for (unsigned int bit = 0;
 				bit < (sizeof(ensitlm::data_t) * CHAR_BIT); ++bit) {
@@ -140,6 +147,20 @@ void Vga::draw()
 	SDL_RenderPresent(renderer);
 }
 
+void Vga::end_of_simulation()
+{
+#ifdef INFO
+	/* Fetching the frame takes time in approximately-timed mode,
+	 * which lowers the frame rate. */
+	double seconds = sc_core::sc_time_stamp().to_seconds();
+	std::cout << "Info: " << sc_module::name() << ": " << frames
+	          << " frames";
+	if (seconds > 0)
+		std::cout << " (" << frames / seconds << " frames/s)";
+	std::cout << "\n";
+#endif
+}
+
 tlm::tlm_response_status Vga::read(ensitlm::addr_t a, ensitlm::data_t &d) {
 	switch (a) {
 	case VGA_CFG_OFFSET:
@@ -179,3 +200,17 @@ tlm::tlm_response_status Vga::write(ensitlm::addr_t a, ensitlm::data_t d) {
 	}
 	return tlm::TLM_OK_RESPONSE;
 }
+
+void Vga::save(std::ostream &os) const
+{
+	put(os, address);
+	put(os, intr);
+	put(os, frames);
+}
+
+void Vga::restore(std::istream &is)
+{
+	get(is, address);
+	get(is, intr);
+	get(is, frames);
+}
@@ -5,10 +5,12 @@
 #define VGA_H
 
 #include "ensitlm.h"
+#include "checkpoint.h"
 
 #include <SDL.h>
+#include <vector>
 
-SC_MODULE(Vga) {
+struct Vga : sc_core::sc_module, checkpointable {
 	SC_HAS_PROCESS(Vga);
 
 	ensitlm::initiator_socket<Vga> initiator;
@@ -22,9 +24,17 @@ SC_MODULE(Vga) {
 
 	tlm::tlm_response_status write(ensitlm::addr_t a, ensitlm::data_t d);
 
+	// The registers and the frame count (the frame is fetched again).
+	void save(std::ostream &os) const;
+	void restore(std::istream &is);
+
 private:
 	ensitlm::addr_t address;
 	bool intr;
+	unsigned long frames;
+
+	/* The last frame fetched, one bit per pixel */
+	std::vector<ensitlm::data_t> frame;
 
 	/* sdl2 objects useful in different parts of the code */
 	SDL_Surface *screen;
@@ -34,6 +44,7 @@ private:
 	void vsync();
 	void thread();
 	void draw();
+	void end_of_simulation();
 };
 
 #endif
@@ -39,10 +39,14 @@
 #include <math.h>
 #include <fenv.h>
 #pragma STDC FENV_ACCESS ON
+#include <algorithm>
 #include <cassert>
+#include <istream>
+#include <ostream>
 #include "soclib_endian.h"
 #include "arithmetics.h"
 #include "rv32.h"
+#include "rv32_ops.h"
 #include "rv32_encodings.h"
 
 /* Not really sure this is helpful, but just in case, ...*/
@@ -416,6 +420,8 @@ static int rounding[] = {
 
 namespace soclib { namespace common {
 
+	using namespace rv32_ops;
+
 	namespace {
 
 		static inline std::string mkname(uint32_t no)
@@ -438,6 +444,11 @@ namespace soclib { namespace common {
 		init(ident);
 	}
 
+	Rv32Iss::~Rv32Iss()
+	{
+		setJit(false);
+	}
+
 	void Rv32Iss::init(uint32_t ident)
 	{
 		char *s = getenv("ISSLOG");
@@ -456,6 +467,12 @@ namespace soclib { namespace common {
 		r_csr[csr_mvendorid] = 0x00bada55;
 		r_csr[csr_misa]      = 0x40001124; /* rv32imfc */
 		r_csr[csr_mimpid]    = 0x02144906; /* soclibvz */
+		flushDecoded();
+		m_data_memory = NULL;
+		m_reserved    = false;
+		m_jit_cache = NULL;
+		m_jit_check = false;
+		setDirectMemory(NULL, 0, 0, false);
 	}
 
 	void Rv32Iss::reset(void)
@@ -475,6 +492,91 @@ namespace soclib { namespace common {
 		m_ir                 = 0x00000013; /* addi x0, x0, 0 */
 	};
 
+	namespace {
+		template <typename T> void put(std::ostream &os, const T &v)
+		{
+			os.write(reinterpret_cast<const char *>(&v), sizeof(v));
+		}
+
+		template <typename T> void get(std::istream &is, T &v)
+		{
+			is.read(reinterpret_cast<char *>(&v), sizeof(v));
+		}
+	}
+
+	void Rv32Iss::saveState(std::ostream &os) const
+	{
+		put(os, r_gpr);
+		put(os, r_fpr);
+		put(os, r_pc);
+		uint32_t ncsr = 0;
+		for (uint32_t i = 0; i < 4096; i++)
+			ncsr += r_csr[i] != 0;
+		put(os, ncsr);
+		for (uint32_t i = 0; i < 4096; i++) {
+			if (r_csr[i] != 0) {
+				put(os, uint16_t(i));
+				put(os, r_csr[i]);
+			}
+		}
+		put(os, m_ir);
+		put(os, m_update_csr);
+		put(os, m_csr_changed);
+		put(os, m_ibe);
+		put(os, m_dbe);
+		put(os, r_dbe);
+		/* The destination register is saved as an index: 0-31 for
+		 * r_gpr, 32-63 for r_fpr */
+		int32_t dest = -1;
+		if (r_mem_dest >= &r_gpr[0] && r_mem_dest < &r_gpr[32])
+			dest = r_mem_dest - &r_gpr[0];
+		else if (r_mem_dest >= (const uint32_t *)&r_fpr[0]
+		         && r_mem_dest < (const uint32_t *)&r_fpr[32])
+			dest = 32 + (r_mem_dest - (const uint32_t *)&r_fpr[0]);
+		put(os, r_mem_req);
+		put(os, r_mem_unsigned);
+		put(os, r_mem_type);
+		put(os, r_mem_addr);
+		put(os, r_mem_wdata);
+		put(os, r_mem_bytes);
+		put(os, dest);
+	}
+
+	void Rv32Iss::restoreState(std::istream &is)
+	{
+		get(is, r_gpr);
+		get(is, r_fpr);
+		get(is, r_pc);
+		uint32_t ncsr;
+		get(is, ncsr);
+		memset(r_csr, 0, sizeof(r_csr));
+		for (uint32_t i = 0; is && i < ncsr; i++) {
+			uint16_t csr;
+			get(is, csr);
+			get(is, r_csr[csr & 0xfff]);
+		}
+		get(is, m_ir);
+		get(is, m_update_csr);
+		get(is, m_csr_changed);
+		get(is, m_ibe);
+		get(is, m_dbe);
+		get(is, r_dbe);
+		int32_t dest;
+		get(is, r_mem_req);
+		get(is, r_mem_unsigned);
+		get(is, r_mem_type);
+		get(is, r_mem_addr);
+		get(is, r_mem_wdata);
+		get(is, r_mem_bytes);
+		get(is, dest);
+		if (dest >= 0 && dest < 32)
+			r_mem_dest = &r_gpr[dest];
+		else if (dest >= 32 && dest < 64)
+			r_mem_dest = (uint32_t *)&r_fpr[dest - 32];
+		else
+			r_mem_dest = NULL;
+	}
+
 	int Rv32Iss::cpuCauseToSignal(uint32_t cause) const
 	{
 		switch (cause) {
@@ -499,6 +601,14 @@ namespace soclib { namespace common {
 
 		switch (r_mem_type) {
 			case DATA_WRITE :
+			{
+				/* The blocks translated from the code written are stale */
+				const uint32_t offset = r_mem_addr - m_dmi_base;
+				if (offset < m_dmi_size
+						&& m_code_pages[offset >> s_code_page_shift])
+					flushBlocks();
+				break;
+			}
 			case XTN_WRITE :
 			case XTN_READ :
 				/* do nothing */
@@ -549,6 +659,86 @@ namespace soclib { namespace common {
 		}
 	}
 
+	void Rv32Iss::setDataMemory(DataMemory *mem)
+	{
+		m_data_memory = mem;
+	}
+
+	/*\
+	 * Does the data request step() just made, as the wrapper and the
+	 * memory would, and completes it with setDataResponse(). The AMOs
+	 * are a read followed by a write, the only hart having no reason to
+	 * lock anything in between.
+	\*/
+	void Rv32Iss::accessData(void)
+	{
+		const uint32_t addr   = r_mem_addr & ~3u;
+		const uint32_t offset = addr - m_dmi_base;
+		const uint8_t  be     = ((1 << r_mem_bytes) - 1) << (r_mem_addr & 3);
+		uint32_t       rdata  = 0;
+		uint32_t       wdata  = r_mem_wdata;
+		bool           read   = false;
+		bool           write  = false;
+		bool           error  = false;
+
+		switch (r_mem_type) {
+			case DATA_READ:
+				read = true;
+				break;
+			case DATA_LR:
+				read          = true;
+				m_reserved    = true;
+				m_reservation = addr;
+				break;
+			case DATA_WRITE:
+				write = true;
+				break;
+			case DATA_SC:
+				write      = m_reserved && m_reservation == addr;
+				rdata      = write ? SC_ATOMIC : SC_NOT_ATOMIC;
+				m_reserved = false;
+				break;
+			case XTN_WRITE:
+			case XTN_READ:
+				break;
+			default: // AMOs
+				read  = true;
+				write = true;
+				break;
+		}
+
+		if (read) {
+			if (offset < m_dmi_size && m_dmi_size - offset >= 4)
+				memcpy(&rdata, m_dmi + offset, 4);
+			else
+				error = !m_data_memory->readData(addr, rdata);
+		}
+
+		if (write && !error) {
+			switch (r_mem_type) {
+				case DATA_AMO_ADD:  wdata = op_add(rdata, wdata); break;
+				case DATA_AMO_AND:  wdata = op_and(rdata, wdata); break;
+				case DATA_AMO_OR:   wdata = op_or(rdata, wdata);  break;
+				case DATA_AMO_XOR:  wdata = op_xor(rdata, wdata); break;
+				case DATA_AMO_MAX:  wdata = op_slt(rdata, wdata) ? wdata : rdata; break;
+				case DATA_AMO_MAXU: wdata = op_sltu(rdata, wdata) ? wdata : rdata; break;
+				case DATA_AMO_MIN:  wdata = op_slt(wdata, rdata) ? wdata : rdata; break;
+				case DATA_AMO_MINU: wdata = op_sltu(wdata, rdata) ? wdata : rdata; break;
+				default: // Store, SC, swap
+					break;
+			}
+			if (offset < m_dmi_wsize && m_dmi_wsize - offset >= 4) {
+				for (int i = 0; i < 4; i++)
+					if (be & (1 << i))
+						m_dmi[offset + i] = wdata >> (8 * i);
+			} else {
+				error = !m_data_memory->writeData(addr, wdata, be);
+			}
+		}
+
+		setDataResponse(error, rdata);
+	}
+
 	void Rv32Iss::getRequests(
 			struct InstructionRequest &ireq,
 			struct DataRequest &dreq) const
@@ -602,6 +792,672 @@ namespace soclib { namespace common {
 		return cycles;
 	}
 
+	/*\
+	 * Decoded instruction cache
+	\*/
+	template <Rv32Iss::AluOp OP>
+	uint32_t Rv32Iss::execOp(const DecodedInsn &d)
+	{
+		r_gpr[d.rd] = OP(r_gpr[d.rs1], r_gpr[d.rs2]);
+		return r_pc + d.length;
+	}
+
+	template <Rv32Iss::AluOp OP>
+	uint32_t Rv32Iss::execOpImm(const DecodedInsn &d)
+	{
+		r_gpr[d.rd] = OP(r_gpr[d.rs1], d.imm);
+		return r_pc + d.length;
+	}
+
+	template <Rv32Iss::AluOp COND>
+	uint32_t Rv32Iss::execBranch(const DecodedInsn &d)
+	{
+		return r_pc + (COND(r_gpr[d.rs1], r_gpr[d.rs2]) ? d.imm : d.length);
+	}
+
+	template <int BYTES, bool UNSIGNED>
+	uint32_t Rv32Iss::execLoad(const DecodedInsn &d)
+	{
+		load(&r_gpr[d.rd], DATA_READ, UNSIGNED, r_gpr[d.rs1] + d.imm, BYTES);
+		return r_pc + d.length;
+	}
+
+	template <int BYTES>
+	uint32_t Rv32Iss::execStore(const DecodedInsn &d)
+	{
+		uint32_t data = r_gpr[d.rs2];
+		/* Replicated on the byte lanes, as in step() */
+		if (BYTES == 1) {
+			data &= 0xff;
+			data  = (data << 24) | (data << 16) | (data << 8) | data;
+		} else if (BYTES == 2) {
+			data &= 0xffff;
+			data  = (data << 16) | data;
+		}
+		store(DATA_WRITE, r_gpr[d.rs1] + d.imm, data, BYTES);
+		return r_pc + d.length;
+	}
+
+	uint32_t Rv32Iss::execLui(const DecodedInsn &d)
+	{
+		r_gpr[d.rd] = d.imm;
+		return r_pc + d.length;
+	}
+
+	uint32_t Rv32Iss::execAuipc(const DecodedInsn &d)
+	{
+		r_gpr[d.rd] = r_pc + d.imm;
+		return r_pc + d.length;
+	}
+
+	uint32_t Rv32Iss::execJal(const DecodedInsn &d)
+	{
+		r_gpr[d.rd] = r_pc + d.length;
+		return r_pc + d.imm;
+	}
+
+	uint32_t Rv32Iss::execJalr(const DecodedInsn &d)
+	{
+		uint32_t next_pc = (r_gpr[d.rs1] + d.imm) & ~1;
+		r_gpr[d.rd] = r_pc + d.length;
+		return next_pc;
+	}
+
+	const Rv32Iss::InsnHandler Rv32Iss::s_exec[INSN_COUNT] = {
+		NULL,
+		&Rv32Iss::execLui,
+		&Rv32Iss::execAuipc,
+		&Rv32Iss::execJal,
+		&Rv32Iss::execJalr,
+		&Rv32Iss::execBranch<op_eq>,
+		&Rv32Iss::execBranch<op_ne>,
+		&Rv32Iss::execBranch<op_slt>,
+		&Rv32Iss::execBranch<op_ge>,
+		&Rv32Iss::execBranch<op_sltu>,
+		&Rv32Iss::execBranch<op_geu>,
+		&Rv32Iss::execLoad<1, false>,
+		&Rv32Iss::execLoad<2, false>,
+		&Rv32Iss::execLoad<4, true>,
+		&Rv32Iss::execLoad<1, true>,
+		&Rv32Iss::execLoad<2, true>,
+		&Rv32Iss::execStore<1>,
+		&Rv32Iss::execStore<2>,
+		&Rv32Iss::execStore<4>,
+		&Rv32Iss::execOpImm<op_add>,
+		&Rv32Iss::execOpImm<op_sll>,
+		&Rv32Iss::execOpImm<op_slt>,
+		&Rv32Iss::execOpImm<op_sltu>,
+		&Rv32Iss::execOpImm<op_xor>,
+		&Rv32Iss::execOpImm<op_srl>,
+		&Rv32Iss::execOpImm<op_sra>,
+		&Rv32Iss::execOpImm<op_or>,
+		&Rv32Iss::execOpImm<op_and>,
+		&Rv32Iss::execOp<op_add>,
+		&Rv32Iss::execOp<op_sub>,
+		&Rv32Iss::execOp<op_sll>,
+		&Rv32Iss::execOp<op_slt>,
+		&Rv32Iss::execOp<op_sltu>,
+		&Rv32Iss::execOp<op_xor>,
+		&Rv32Iss::execOp<op_srl>,
+		&Rv32Iss::execOp<op_sra>,
+		&Rv32Iss::execOp<op_or>,
+		&Rv32Iss::execOp<op_and>,
+		&Rv32Iss::execOp<op_mul>,
+		&Rv32Iss::execOp<op_mulh>,
+		&Rv32Iss::execOp<op_mulhsu>,
+		&Rv32Iss::execOp<op_mulhu>,
+		&Rv32Iss::execOp<op_div>,
+		&Rv32Iss::execOp<op_divu>,
+		&Rv32Iss::execOp<op_rem>,
+		&Rv32Iss::execOp<op_remu>,
+	};
+
+	void Rv32Iss::flushDecoded(void)
+	{
+		DecodedInsn none = {1, 0, NULL, INSN_NONE, 0, 0, 0, 0, 0}; // pc is never odd
+		m_decoded.assign(s_decoded_size, none);
+	}
+
+	/*\
+	 * Fills d for the instruction m_ir at r_pc, with a NULL handler for
+	 * the instructions left to step(): system, fence, atomic, floating
+	 * point, and the encodings it reports as unknown
+	\*/
+	void Rv32Iss::decode(DecodedInsn &d)
+	{
+		int rd = 0, rs1 = 0, rs2 = 0, imm = 0;
+		DecodedOp op = INSN_NONE;
+		int length = 4;
+
+		d.pc = r_pc;
+		d.ir = m_ir;
+
+		switch (m_ir & 0x7f) {
+			case 0b0110111: // LUI
+				decode_u_type(rd, imm);
+				op = INSN_LUI;
+				break;
+			case 0b0010111: // AUIPC
+				decode_u_type(rd, imm);
+				op = INSN_AUIPC;
+				break;
+			case 0b1101111: // JAL
+				decode_j_type(rd, imm);
+				op = INSN_JAL;
+				break;
+			case 0b1100111: // JALR
+				decode_i_type(rd, rs1, imm);
+				op = INSN_JALR;
+				break;
+			case 0b1100011: // Branches
+				decode_b_type(rs1, rs2, imm);
+				switch ((m_ir >> 12) & 0x7) {
+					case 0b000: op = INSN_BEQ;  break;
+					case 0b001: op = INSN_BNE;  break;
+					case 0b100: op = INSN_BLT;  break;
+					case 0b101: op = INSN_BGE;  break;
+					case 0b110: op = INSN_BLTU; break;
+					case 0b111: op = INSN_BGEU; break;
+				}
+				break;
+			case 0b0000011: // Loads
+				decode_i_type(rd, rs1, imm);
+				switch ((m_ir >> 12) & 0x7) {
+					case 0b000: op = INSN_LB;  break;
+					case 0b001: op = INSN_LH;  break;
+					case 0b010: op = INSN_LW;  break;
+					case 0b100: op = INSN_LBU; break;
+					case 0b101: op = INSN_LHU; break;
+				}
+				break;
+			case 0b0100011: // Stores
+				decode_s_type(rs1, rs2, imm);
+				switch ((m_ir >> 12) & 0x7) {
+					case 0b000: op = INSN_SB; break;
+					case 0b001: op = INSN_SH; break;
+					case 0b010: op = INSN_SW; break;
+				}
+				break;
+			case 0b0010011: // Immediate operations
+				decode_i_type(rd, rs1, imm);
+				switch ((m_ir >> 12) & 0x7) {
+					case 0b000: op = INSN_ADDI;  break;
+					case 0b001: op = INSN_SLLI;  break;
+					case 0b010: op = INSN_SLTI;  break;
+					case 0b011: op = INSN_SLTIU; break;
+					case 0b100: op = INSN_XORI;  break;
+					case 0b101:
+						if ((m_ir & 0xfe000000) == 0x00000000)
+							op = INSN_SRLI;
+						else if ((m_ir & 0xfe000000) == 0x40000000)
+							op = INSN_SRAI;
+						break;
+					case 0b110: op = INSN_ORI;   break;
+					case 0b111: op = INSN_ANDI;  break;
+				}
+				break;
+			case 0b0110011: // Register operations
+				decode_r_type(rd, rs1, rs2);
+				switch (m_ir & 0xfe007000) {
+					case 0x00000000: op = INSN_ADD;    break;
+					case 0x40000000: op = INSN_SUB;    break;
+					case 0x00001000: op = INSN_SLL;    break;
+					case 0x00002000: op = INSN_SLT;    break;
+					case 0x00003000: op = INSN_SLTU;   break;
+					case 0x00004000: op = INSN_XOR;    break;
+					case 0x00005000: op = INSN_SRL;    break;
+					case 0x40005000: op = INSN_SRA;    break;
+					case 0x00006000: op = INSN_OR;     break;
+					case 0x00007000: op = INSN_AND;    break;
+					case 0x02000000: op = INSN_MUL;    break;
+					case 0x02001000: op = INSN_MULH;   break;
+					case 0x02002000: op = INSN_MULHSU; break;
+					case 0x02003000: op = INSN_MULHU;  break;
+					case 0x02004000: op = INSN_DIV;    break;
+					case 0x02005000: op = INSN_DIVU;   break;
+					case 0x02006000: op = INSN_REM;    break;
+					case 0x02007000: op = INSN_REMU;   break;
+				}
+				break;
+			default:
+				if ((m_ir & 0b11) == 0b11)
+					break;
+				/*\
+				 * Compressed instructions, expanded into their 32-bit
+				 * equivalent (the ones step() reports as unknown or
+				 * illegal are left to it)
+				\*/
+				m_ir  &= 0xffff;
+				length = 2;
+				switch (m_ir & 0xe003) {
+					case 0x0000: // C.ADDI4SPN
+						decode_ciw_type(rd, imm);
+						rs1 = 2;
+						if (imm != 0)
+							op = INSN_ADDI;
+						break;
+					case 0x4000: // C.LW
+						decode_cl_type(rd, rs1, imm);
+						op = INSN_LW;
+						break;
+					case 0xc000: // C.SW
+						decode_cs_type(rs2, rs1, imm);
+						op = INSN_SW;
+						break;
+					case 0x0001: // C.NOP, C.ADDI
+						decode_ci_type(rd, imm);
+						rs1 = rd;
+						op  = INSN_ADDI;
+						break;
+					case 0x2001: // C.JAL
+						decode_cj_type(imm);
+						rd  = 1;
+						op  = INSN_JAL;
+						break;
+					case 0x4001: // C.LI
+						decode_ci_type(rd, imm);
+						rs1 = 0;
+						op  = INSN_ADDI;
+						break;
+					case 0x6001:
+						if (((m_ir >> 7) & 0x1f) == 2) { // C.ADDI16SP
+							decode_cisp_type(rd, imm);
+							rs1 = 2;
+							op  = INSN_ADDI;
+						} else { // C.LUI
+							decode_ci_type(rd, imm);
+							imm = (uint32_t)imm << 12;
+							op  = INSN_LUI;
+						}
+						break;
+					case 0x8001:
+						decode_cis_type(rd, imm);
+						rs1 = rd;
+						switch (m_ir & 0x0c00) {
+							case 0x0000: op = INSN_SRLI; break;
+							case 0x0400: op = INSN_SRAI; break;
+							case 0x0800: op = INSN_ANDI; break;
+							case 0x0c00:
+								decode_cs_type(rs2, rs1, imm);
+								rd = rs1;
+								if (m_ir & 0x1000)
+									break;
+								switch (m_ir & 0x60) {
+									case 0x00: op = INSN_SUB; break;
+									case 0x20: op = INSN_XOR; break;
+									case 0x40: op = INSN_OR;  break;
+									case 0x60: op = INSN_AND; break;
+								}
+								break;
+						}
+						break;
+					case 0xa001: // C.J
+						decode_cj_type(imm);
+						rd  = 0;
+						op  = INSN_JAL;
+						break;
+					case 0xc001: // C.BEQZ
+						decode_cb_type(rs1, imm);
+						rs2 = 0;
+						op  = INSN_BEQ;
+						break;
+					case 0xe001: // C.BNEZ
+						decode_cb_type(rs1, imm);
+						rs2 = 0;
+						op  = INSN_BNE;
+						break;
+					case 0x0002: // C.SLLI
+						decode_ci_type(rd, imm);
+						rs1 = rd;
+						op  = INSN_SLLI;
+						break;
+					case 0x4002: // C.LWSP
+						decode_cils_type(rd, imm);
+						rs1 = 2;
+						op  = INSN_LW;
+						break;
+					case 0x8002:
+						decode_cr_type(rs1, rs2);
+						if (rs1 == 0) // c.jr/c.jalr with rs1 = 0, c.ebreak
+							break;
+						if (rs2 != 0) { // C.MV, C.ADD
+							rd  = rs1;
+							rs1 = (m_ir & 0x1000) ? rd : 0;
+							op  = INSN_ADD;
+						} else { // C.JR, C.JALR
+							rd  = (m_ir & 0x1000) ? 1 : 0;
+							imm = 0;
+							op  = INSN_JALR;
+						}
+						break;
+					case 0xc002: // C.SWSP
+						decode_css_type(rs2, imm);
+						rs1 = 2;
+						op  = INSN_SW;
+						break;
+				}
+		}
+
+		d.op     = op;
+		d.exec   = s_exec[op];
+		d.rd     = rd;
+		d.rs1    = rs1;
+		d.rs2    = rs2;
+		d.length = length;
+		d.imm    = imm;
+	}
+
+	/*\
+	 * Block execution
+	\*/
+	void Rv32Iss::setDirectMemory(uint8_t *host, uint32_t base,
+	                              uint32_t size, bool writable)
+	{
+		flushBlocks();
+		m_dmi       = host;
+		m_dmi_base  = base;
+		m_dmi_size  = host ? size : 0;
+		m_dmi_wsize = writable ? m_dmi_size : 0;
+		m_code_pages.assign(host ? ((size - 1) >> s_code_page_shift) + 1 : 0,
+		                    0);
+	}
+
+	void Rv32Iss::flushBlocks(void)
+	{
+		m_blocks.clear();
+		std::fill(m_code_pages.begin(), m_code_pages.end(), 0);
+		m_jit_used = 0;
+	}
+
+	/*\
+	 * Returns the block starting at pc, translating it if needed. Its
+	 * first instruction is INSN_NONE when step() has to execute it.
+	\*/
+	Rv32Iss::Block *Rv32Iss::findBlock(uint32_t pc)
+	{
+		std::unordered_map<uint32_t, Block>::iterator i = m_blocks.find(pc);
+		if (i != m_blocks.end())
+			return &i->second;
+
+		Block &b = m_blocks[pc];
+		b.next_pc[0] = b.next_pc[1] = 1; // pc is never odd
+		b.next[0]    = b.next[1]    = NULL;
+		b.runs       = 0;
+		b.jit        = NULL;
+
+		/* decode() works on r_pc and m_ir */
+		const uint32_t pc_saved = r_pc;
+		const uint32_t ir_saved = m_ir;
+		DecodedInsn d;
+		r_pc = pc;
+		for (;;) {
+			const uint32_t offset = r_pc - m_dmi_base;
+			if (offset >= m_dmi_size || m_dmi_size - offset < 4
+					|| b.insns.size() == s_block_max) {
+				d.pc = r_pc;
+				d.op = INSN_NONE;
+			} else {
+				memcpy(&m_ir, m_dmi + offset, 4);
+				decode(d);
+				m_code_pages[offset >> s_code_page_shift] = 1;
+				m_code_pages[(offset + d.length - 1) >> s_code_page_shift] = 1;
+			}
+			b.insns.push_back(d);
+
+			switch (d.op) {
+				case INSN_NONE:
+					b.next_pc[1] = d.pc;
+					break;
+				case INSN_JAL:
+					b.next_pc[0] = d.pc + d.imm;
+					break;
+				case INSN_JALR:
+					break;
+				case INSN_BEQ: case INSN_BNE:  case INSN_BLT:
+				case INSN_BGE: case INSN_BLTU: case INSN_BGEU:
+					b.next_pc[0] = d.pc + d.imm;
+					b.next_pc[1] = d.pc + d.length;
+					break;
+				default:
+					r_pc += d.length;
+					continue;
+			}
+			break;
+		}
+		r_pc = pc_saved;
+		m_ir = ir_saved;
+		return &b;
+	}
+
+	uint32_t Rv32Iss::runBlocks(uint32_t max)
+	{
+		/* Same order as DecodedOp */
+		static const void *const ops[INSN_COUNT] = {
+			&&insn_none,
+			&&insn_lui, &&insn_auipc, &&insn_jal, &&insn_jalr,
+			&&insn_beq, &&insn_bne, &&insn_blt,
+			&&insn_bge, &&insn_bltu, &&insn_bgeu,
+			&&insn_lb, &&insn_lh, &&insn_lw, &&insn_lbu, &&insn_lhu,
+			&&insn_sb, &&insn_sh, &&insn_sw,
+			&&insn_addi, &&insn_slli, &&insn_slti, &&insn_sltiu, &&insn_xori,
+			&&insn_srli, &&insn_srai, &&insn_ori, &&insn_andi,
+			&&insn_add, &&insn_sub, &&insn_sll, &&insn_slt, &&insn_sltu,
+			&&insn_xor, &&insn_srl, &&insn_sra, &&insn_or, &&insn_and,
+			&&insn_mul, &&insn_mulh, &&insn_mulhsu, &&insn_mulhu,
+			&&insn_div, &&insn_divu, &&insn_rem, &&insn_remu,
+		};
+		uint32_t        retired = 0;
+		uint32_t        next_pc;
+		uint32_t        offset;
+		uint16_t        half;
+		uint32_t        word;
+		Block          *b;
+		const DecodedInsn *d;
+
+		if (m_dmi == NULL || r_mem_req || m_dbe || r_dbe)
+			return 0;
+		if ((r_csr[csr_mip] & r_csr[csr_mie]) && (r_csr[csr_mstatus] & 0x8))
+			return 0;
+
+		b = findBlock(r_pc);
+		if (b->insns[0].op == INSN_NONE)
+			return 0;
+
+/* Executes the next instruction of the block, with a zeroed r0 */
+#define next_insn()                                          \
+	do {                                                      \
+		r_gpr[0] = 0;                                          \
+		d++;                                                   \
+		goto *ops[d->op];                                      \
+	} while (0)
+
+/* Sets offset for an access of bytes at rs1 + imm, or leaves the block
+ * before this instruction if step() has to do it */
+#define dmi_offset(limit, bytes)                             \
+	do {                                                      \
+		offset = r_gpr[d->rs1] + d->imm - m_dmi_base;          \
+		if (unlikely((uint64_t)offset + bytes > (limit)        \
+				|| (offset & (bytes - 1))))                        \
+			goto leave;                                         \
+	} while (0)
+
+/* Leaves the block after a store to translated code, which is gone */
+#define check_code()                                         \
+	do {                                                      \
+		if (unlikely(m_code_pages[offset >> s_code_page_shift])) { \
+			retired += d - &b->insns[0] + 1;                    \
+			r_pc = d->pc + d->length;                           \
+			flushBlocks();                                      \
+			return retired;                                     \
+		}                                                      \
+	} while (0)
+
+#define alu(op, operand)                                     \
+	do {                                                      \
+		r_gpr[d->rd] = op(r_gpr[d->rs1], operand);             \
+		next_insn();                                                \
+	} while (0)
+
+#define branch(cond)                                         \
+	do {                                                      \
+		next_pc = d->pc + (cond(r_gpr[d->rs1], r_gpr[d->rs2])  \
+				? d->imm : d->length);                              \
+		goto block_end;                                        \
+	} while (0)
+
+	run_block:
+		if (b->jit == NULL && m_jit_cache != NULL
+				&& ++b->runs == s_jit_threshold)
+			jitCompile(*b);
+		if (b->jit != NULL) {
+			const uint64_t r = m_jit_check ? jitCheck(*b)
+				: b->jit(r_gpr, m_dmi, m_code_pages.data());
+			retired += (r >> 32) & 0xffff;
+			next_pc  = r;
+			if (r & (s_jit_leave | s_jit_flush)) {
+				r_pc = next_pc;
+				if (r & s_jit_flush)
+					flushBlocks();
+				return retired;
+			}
+			goto chain;
+		}
+		d = &b->insns[0];
+		goto *ops[d->op];
+
+	insn_lui:
+		r_gpr[d->rd] = d->imm;
+		next_insn();
+	insn_auipc:
+		r_gpr[d->rd] = d->pc + d->imm;
+		next_insn();
+	insn_jal:
+		r_gpr[d->rd] = d->pc + d->length;
+		next_pc = d->pc + d->imm;
+		goto block_end;
+	insn_jalr:
+		next_pc = (r_gpr[d->rs1] + d->imm) & ~1;
+		r_gpr[d->rd] = d->pc + d->length;
+		goto block_end;
+
+	insn_beq:    branch(op_eq);
+	insn_bne:    branch(op_ne);
+	insn_blt:    branch(op_slt);
+	insn_bge:    branch(op_ge);
+	insn_bltu:   branch(op_sltu);
+	insn_bgeu:   branch(op_geu);
+
+	insn_lb:
+		dmi_offset(m_dmi_size, 1);
+		r_gpr[d->rd] = (int8_t)m_dmi[offset];
+		next_insn();
+	insn_lh:
+		dmi_offset(m_dmi_size, 2);
+		memcpy(&half, m_dmi + offset, 2);
+		r_gpr[d->rd] = (int16_t)half;
+		next_insn();
+	insn_lw:
+		dmi_offset(m_dmi_size, 4);
+		memcpy(&word, m_dmi + offset, 4);
+		r_gpr[d->rd] = word;
+		next_insn();
+	insn_lbu:
+		dmi_offset(m_dmi_size, 1);
+		r_gpr[d->rd] = m_dmi[offset];
+		next_insn();
+	insn_lhu:
+		dmi_offset(m_dmi_size, 2);
+		memcpy(&half, m_dmi + offset, 2);
+		r_gpr[d->rd] = half;
+		next_insn();
+
+	insn_sb:
+		dmi_offset(m_dmi_wsize, 1);
+		m_dmi[offset] = r_gpr[d->rs2];
+		check_code();
+		next_insn();
+	insn_sh:
+		dmi_offset(m_dmi_wsize, 2);
+		half = r_gpr[d->rs2];
+		memcpy(m_dmi + offset, &half, 2);
+		check_code();
+		next_insn();
+	insn_sw:
+		dmi_offset(m_dmi_wsize, 4);
+		memcpy(m_dmi + offset, &r_gpr[d->rs2], 4);
+		check_code();
+		next_insn();
+
+	insn_addi:   alu(op_add, d->imm);
+	insn_slli:   alu(op_sll, d->imm);
+	insn_slti:   alu(op_slt, d->imm);
+	insn_sltiu:  alu(op_sltu, d->imm);
+	insn_xori:   alu(op_xor, d->imm);
+	insn_srli:   alu(op_srl, d->imm);
+	insn_srai:   alu(op_sra, d->imm);
+	insn_ori:    alu(op_or, d->imm);
+	insn_andi:   alu(op_and, d->imm);
+	insn_add:    alu(op_add, r_gpr[d->rs2]);
+	insn_sub:    alu(op_sub, r_gpr[d->rs2]);
+	insn_sll:    alu(op_sll, r_gpr[d->rs2]);
+	insn_slt:    alu(op_slt, r_gpr[d->rs2]);
+	insn_sltu:   alu(op_sltu, r_gpr[d->rs2]);
+	insn_xor:    alu(op_xor, r_gpr[d->rs2]);
+	insn_srl:    alu(op_srl, r_gpr[d->rs2]);
+	insn_sra:    alu(op_sra, r_gpr[d->rs2]);
+	insn_or:     alu(op_or, r_gpr[d->rs2]);
+	insn_and:    alu(op_and, r_gpr[d->rs2]);
+	insn_mul:    alu(op_mul, r_gpr[d->rs2]);
+	insn_mulh:   alu(op_mulh, r_gpr[d->rs2]);
+	insn_mulhsu: alu(op_mulhsu, r_gpr[d->rs2]);
+	insn_mulhu:  alu(op_mulhu, r_gpr[d->rs2]);
+	insn_div:    alu(op_div, r_gpr[d->rs2]);
+	insn_divu:   alu(op_divu, r_gpr[d->rs2]);
+	insn_rem:    alu(op_rem, r_gpr[d->rs2]);
+	insn_remu:   alu(op_remu, r_gpr[d->rs2]);
+
+#undef next_insn
+#undef dmi_offset
+#undef check_code
+#undef alu
+#undef branch
+
+	insn_none:
+		/* End of a block that does not end with a jump */
+		retired += d - &b->insns[0];
+		next_pc  = d->pc;
+		goto chain;
+
+	block_end:
+		retired += d - &b->insns[0] + 1;
+	chain:
+		r_gpr[0] = 0;
+		r_pc     = next_pc;
+		if (retired >= max)
+			return retired;
+		if (next_pc == b->next_pc[0]) {
+			if (b->next[0] == NULL)
+				b->next[0] = findBlock(next_pc);
+			b = b->next[0];
+		} else if (next_pc == b->next_pc[1]) {
+			if (b->next[1] == NULL)
+				b->next[1] = findBlock(next_pc);
+			b = b->next[1];
+		} else {
+			b = findBlock(next_pc);
+		}
+		if (b->insns[0].op != INSN_NONE)
+			goto run_block;
+		return retired;
+
+	leave:
+		/* Before d, which step() executes */
+		retired += d - &b->insns[0];
+		r_gpr[0] = 0;
+		r_pc     = d->pc;
+		return retired;
+	}
+
 	void Rv32Iss::step(void)
 	{
 		asm_str;
@@ -785,6 +1641,20 @@ __iss_handle_exception:
 			 * set, and are named C0/C1/C2 in the document.
 			\*/
 
+#if RV32_DISAS != 1
+			/*\
+			 * Instructions found in the decoded instruction cache skip
+			 * the decoding below
+			\*/
+			DecodedInsn &decoded = m_decoded[(r_pc >> 1) & (s_decoded_size - 1)];
+			if (unlikely(decoded.pc != r_pc || decoded.ir != m_ir))
+				decode(decoded);
+			if (decoded.exec != NULL) {
+				next_pc = (this->*decoded.exec)(decoded);
+				goto skip_next_pc;
+			}
+#endif
+
 			switch (m_ir & 0x7f) {
 				case 0b0110111: // U-type LUI rd,imm
 					decode_u_type(rd, imm);
@@ -1153,6 +2023,8 @@ __iss_handle_exception:
 					} else if (m_ir == 0x0000100f) { // FENCE.I
 							asm_out("%s", "fence.i");
 							store(XTN_WRITE, XTN_ICACHE_FLUSH << 2, 0, 0);
+							flushDecoded();
+							flushBlocks();
 					} else {
 						fprintf(stderr, "Unknown fence instruction\n");
 					}
@@ -2163,7 +3035,7 @@ do {                                         \
 										r_gpr[rs1] = r_gpr[rs2];
 									} else {
 										c_asm_out("c.jr	x%d", rs1);
-										next_pc = r_gpr[rs1];
+										next_pc = r_gpr[rs1] & ~1;
 										goto skip_next_pc;
 									}
 								} else {
@@ -2179,8 +3051,9 @@ do {                                         \
 										r_gpr[rs1] += r_gpr[rs2];
 									} else {
 										c_asm_out("c.jalr	x%d", rs1);
+										// rs1 may be ra: read it first
+										next_pc = r_gpr[rs1] & ~1;
 										r_gpr[1] = r_pc + 2;
-										next_pc = r_gpr[rs1];
 										goto skip_next_pc;
 									}
 								}
@@ -2206,6 +3079,12 @@ do {                                         \
 					/* end of the case default, 276 lines later */
 			}
 skip_next_pc:
+			/*\
+			 * Synchronous data access, before r0 gets zeroed in case
+			 * it is the destination
+			\*/
+			if (r_mem_req && m_data_memory != NULL)
+				accessData();
 			/*\
 			 * Ensures that we get out of here with a zeroed r0
 			\*/
@@ -22,6 +22,9 @@
 #include "register.h"
 #include "rv32xml.h"
 
+#include <unordered_map>
+#include <vector>
+
 /*\
  *  Rv32 Processor structure definition
 \*/
@@ -30,6 +33,19 @@ namespace common {
 	class Rv32Iss
 		: public soclib::common::Iss2
 	{
+	public:
+		/*\
+		 * Memory for the synchronous data accesses (see setDataMemory()),
+		 * on the word containing the address as with the handshake, the
+		 * accesses returning false on a bus error
+		\*/
+		struct DataMemory {
+			virtual ~DataMemory() {}
+			virtual bool readData(uint32_t addr, uint32_t &rdata) = 0;
+			virtual bool writeData(uint32_t addr, uint32_t wdata,
+			                       uint8_t be) = 0;
+		};
+
 	private:
 		// Vectors are platform specific according to section 3.3 of the priviledged spec
 		// We use one we saw somewhere, ..., all are created equals I believe
@@ -324,7 +340,117 @@ namespace common {
 
 		bool                m_ibe;
 
+		bool                m_reserved;     // By LR, for SC (synchronous accesses)
+		uint32_t            m_reservation;
+
 		FILE               *dumpFile;       // File to log instructions
+		DataMemory         *m_data_memory;  // NULL for the handshake
+
+		/*\
+		 * Decoded instruction cache: the most common instructions are
+		 * decoded once into a handler and its operands, compressed ones
+		 * being expanded into the same form, and then executed from the
+		 * cache as long as the same word is fetched at the same pc.
+		 * Comparing the fetched word catches the code modified by any
+		 * initiator, FENCE.I flushes it anyway.
+		\*/
+		enum DecodedOp {
+			INSN_NONE, // Left to step()
+			INSN_LUI, INSN_AUIPC, INSN_JAL, INSN_JALR,
+			INSN_BEQ, INSN_BNE, INSN_BLT, INSN_BGE, INSN_BLTU, INSN_BGEU,
+			INSN_LB, INSN_LH, INSN_LW, INSN_LBU, INSN_LHU,
+			INSN_SB, INSN_SH, INSN_SW,
+			INSN_ADDI, INSN_SLLI, INSN_SLTI, INSN_SLTIU, INSN_XORI,
+			INSN_SRLI, INSN_SRAI, INSN_ORI, INSN_ANDI,
+			INSN_ADD, INSN_SUB, INSN_SLL, INSN_SLT, INSN_SLTU,
+			INSN_XOR, INSN_SRL, INSN_SRA, INSN_OR, INSN_AND,
+			INSN_MUL, INSN_MULH, INSN_MULHSU, INSN_MULHU,
+			INSN_DIV, INSN_DIVU, INSN_REM, INSN_REMU,
+			INSN_COUNT
+		};
+		struct DecodedInsn;
+		typedef uint32_t (Rv32Iss::*InsnHandler)(const DecodedInsn &d);
+		struct DecodedInsn {
+			uint32_t    pc;
+			uint32_t    ir;       // Word fetched at pc
+			InsnHandler exec;     // Returns the next pc, NULL if not cached
+			uint8_t     op;       // DecodedOp
+			uint8_t     rd;
+			uint8_t     rs1;
+			uint8_t     rs2;
+			uint8_t     length;   // 2 or 4 bytes
+			int32_t     imm;
+		};
+		static const size_t s_decoded_size = 4096; // Direct mapped on pc
+		static const InsnHandler s_exec[INSN_COUNT];
+		std::vector<DecodedInsn> m_decoded;
+
+		void decode(DecodedInsn &d);
+		void flushDecoded(void);
+
+		typedef uint32_t (*AluOp)(uint32_t a, uint32_t b);
+		template <AluOp OP> uint32_t execOp(const DecodedInsn &d);
+		template <AluOp OP> uint32_t execOpImm(const DecodedInsn &d);
+		template <AluOp COND> uint32_t execBranch(const DecodedInsn &d);
+		template <int BYTES, bool UNSIGNED> uint32_t execLoad(const DecodedInsn &d);
+		template <int BYTES> uint32_t execStore(const DecodedInsn &d);
+		uint32_t execLui(const DecodedInsn &d);
+		uint32_t execAuipc(const DecodedInsn &d);
+		uint32_t execJal(const DecodedInsn &d);
+		uint32_t execJalr(const DecodedInsn &d);
+
+		/*\
+		 * Block execution: the straight-line code up to a control
+		 * transfer, or to an instruction left to step(), is decoded
+		 * once into a block, which runBlocks() executes with a threaded
+		 * dispatch. Blocks are chained on their static successors, and
+		 * only access the memory given to setDirectMemory().
+		\*/
+		typedef uint64_t (*JitCode)(uint32_t *gpr, uint8_t *dmi,
+		                            const uint8_t *code_pages);
+		struct Block {
+			std::vector<DecodedInsn> insns; // Ends with INSN_NONE or a jump
+			uint32_t next_pc[2];            // Static successors
+			Block   *next[2];               // The blocks at next_pc
+			uint32_t runs;                  // Until translated
+			JitCode  jit;                   // Host code, or NULL
+		};
+		std::unordered_map<uint32_t, Block> m_blocks;
+		static const size_t s_block_max = 64;   // Instructions
+
+		uint8_t             *m_dmi;          // Host address of m_dmi_base
+		uint32_t             m_dmi_base;
+		uint32_t             m_dmi_size;     // Readable bytes
+		uint32_t             m_dmi_wsize;    // Writable bytes
+		std::vector<uint8_t> m_code_pages;   // Pages translated into blocks
+		static const int     s_code_page_shift = 12;
+
+		Block *findBlock(uint32_t pc);
+		void flushBlocks(void);
+
+		/*\
+		 * Translation of the hot blocks into host code (rv32_jit.cpp):
+		 * a block run s_jit_threshold times is translated into the code
+		 * cache, which runBlocks() then calls instead of interpreting
+		 * it. The translation reads and writes the registers in r_gpr
+		 * and accesses the direct memory inline. It returns the next pc
+		 * in bits 0-31 and the instructions retired in bits 32-47, with
+		 * s_jit_leave when the instruction at pc has to go through
+		 * step(), or s_jit_flush after a store into translated code.
+		\*/
+		static const uint64_t s_jit_leave      = 1ULL << 62;
+		static const uint64_t s_jit_flush      = 1ULL << 63;
+		static const uint32_t s_jit_threshold  = 64;
+		static const size_t   s_jit_cache_size = 4 << 20;
+
+		uint8_t             *m_jit_cache;    // NULL when not translating
+		size_t               m_jit_used;     // Bytes, up to the next flush
+		bool                 m_jit_check;    // Run step() along, to compare
+
+		bool jitCompile(Block &b);
+		uint64_t jitCheck(Block &b);
+
+		void accessData(void);
 
 		/*\
 		 *  Private initialization routine used by constructors
@@ -353,6 +479,15 @@ namespace common {
 		\*/
 		void setDataResponse(bool error, uint32_t rdata);
 
+		/*\
+		 * Synchronous data accesses: with a memory set, step() does its
+		 * loads, stores and AMOs itself, in the direct memory when they
+		 * fall in it and through the memory otherwise, so that
+		 * getDataRequest() has nothing left to ask. NULL goes back to
+		 * the handshake.
+		\*/
+		void setDataMemory(DataMemory *mem);
+
 		inline void getDataRequest(
 			bool &valid,
 			enum DataOperationType &type,
@@ -380,17 +515,52 @@ namespace common {
 		\*/
 		Rv32Iss(const std::string &name, uint32_t ident);
 		Rv32Iss(uint32_t ident);
+		~Rv32Iss();
 
 		/*\
 		 * Reset handling
 		\*/
 		void reset(void);
 
+		/*\
+		 * Checkpointing: architectural state (registers, pc, non-zero
+		 * csrs) and pending memory request, between two step()s
+		\*/
+		void saveState(std::ostream &os) const;
+		void restoreState(std::istream &is);
+
 		/*\
 		 * Single stepping
 		\*/
 		void step(void);
 
+		/*\
+		 * Block execution (the host must be little-endian): memory that
+		 * runBlocks() may access directly, with host the address of base
+		 * on the host, or NULL to stop using it
+		\*/
+		void setDirectMemory(uint8_t *host, uint32_t base, uint32_t size,
+		                     bool writable);
+
+		/*\
+		 * Executes whole blocks until at least max instructions are
+		 * retired, and returns their number. Returns early, possibly 0,
+		 * when the next instruction must go through step(): outside of
+		 * the direct memory, not decoded (csr, fp, ...), accessing data
+		 * outside of the direct memory or misaligned, pending memory
+		 * request, exception or interrupt.
+		\*/
+		uint32_t runBlocks(uint32_t max);
+
+		/*\
+		 * Translates the hot blocks run by runBlocks() into host code,
+		 * on x86-64 only: returns false when enabling it is not
+		 * possible. With check, each translated block is executed by
+		 * step() first, and the simulation aborts when the states
+		 * differ after the block.
+		\*/
+		bool setJit(bool enable, bool check = false);
+
 		/*\
 		 * ISS execute function
 		\*/
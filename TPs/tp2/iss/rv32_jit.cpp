@@ -0,0 +1,558 @@
+/*\
+ * vim: tw=0: cindent: sw=3: ts=3: sts=3: noet: list
+ *
+ * Translation of the hot blocks of the Rv32 ISS into x86-64 code.
+ *
+ * A translated block is a function following the System V ABI, called
+ * by runBlocks() with the guest registers, the direct memory and the
+ * code pages. Each instruction loads its operands from the guest
+ * registers into eax and ecx, computes into eax and stores it back, so
+ * that the registers are always up to date when leaving the block.
+\*/
+
+#include "rv32.h"
+#include "rv32_ops.h"
+
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+namespace soclib { namespace common {
+
+	using namespace rv32_ops;
+
+#if defined(__x86_64__)
+	namespace {
+		/* Registers, as encoded in the ModRM byte */
+		enum { EAX = 0, ECX = 1, EDX = 2 };
+
+		typedef uint32_t (*AluOp)(uint32_t a, uint32_t b);
+
+		/* Condition codes of jcc and cmovcc */
+		enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5,
+		       CC_A = 0x7, CC_L = 0xc, CC_GE = 0xd };
+
+		/*\
+		 * Just enough of an x86-64 assembler. rbx holds the address of
+		 * the guest registers, r12 the one of the direct memory and r13
+		 * the one of the code pages. Writes past the end are dropped,
+		 * and full() tells that the code did not fit.
+		 * The registers are written through, but the last one written
+		 * from eax is read from there as long as eax is not changed,
+		 * which saves a store to load forwarding on dependent code.
+		\*/
+		class Emitter {
+		public:
+			Emitter(uint8_t *begin, uint8_t *end)
+				: m_p(begin), m_end(end), m_eax(-1)
+			{
+			}
+
+			uint8_t *pos(void) const
+			{
+				return m_p;
+			}
+
+			bool full(void) const
+			{
+				return m_p > m_end;
+			}
+
+			void emit(std::initializer_list<uint8_t> bytes)
+			{
+				for (uint8_t b : bytes) {
+					if (m_p < m_end)
+						*m_p = b;
+					m_p++;
+				}
+			}
+
+			void imm32(uint32_t v)
+			{
+				emit({(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16),
+				      (uint8_t)(v >> 24)});
+			}
+
+			void imm64(uint64_t v)
+			{
+				imm32(v);
+				imm32(v >> 32);
+			}
+
+			/* reg = x[r], eax being then about to change */
+			void loadReg(int reg, int r)
+			{
+				if (r == 0)
+					emit({0x31, (uint8_t)(0xc0 | reg << 3 | reg)}); // xor
+				else if (r == m_eax && reg == EAX)
+					;
+				else if (r == m_eax)
+					emit({0x89, (uint8_t)(0xc0 | reg)});            // mov reg, eax
+				else
+					emit({0x8b, (uint8_t)(0x43 | reg << 3), (uint8_t)(4 * r)});
+				if (reg == EAX)
+					m_eax = -1;
+			}
+
+			/* x[r] = reg, x0 being never written */
+			void storeReg(int reg, int r)
+			{
+				if (r != 0)
+					emit({0x89, (uint8_t)(0x43 | reg << 3), (uint8_t)(4 * r)});
+				if (reg == EAX)
+					m_eax = r != 0 ? r : -1;
+			}
+
+			/* reg = v */
+			void movImm(int reg, uint32_t v)
+			{
+				emit({(uint8_t)(0xb8 | reg)});
+				imm32(v);
+				if (reg == EAX)
+					m_eax = -1;
+			}
+
+			/* Jumps to a target known later: returns what to patch */
+			uint8_t *jcc(int cc)
+			{
+				emit({0x0f, (uint8_t)(0x80 | cc)});
+				imm32(0);
+				return m_p - 4;
+			}
+
+			uint8_t *jmp(void)
+			{
+				emit({0xe9});
+				imm32(0);
+				return m_p - 4;
+			}
+
+			void patch(uint8_t *rel, uint8_t *target)
+			{
+				if (full())
+					return;
+				const int32_t v = target - (rel + 4);
+				memcpy(rel, &v, 4);
+			}
+
+			void prologue(void)
+			{
+				emit({0x53, 0x41, 0x54, 0x41, 0x55}); // push rbx, r12, r13
+				emit({0x48, 0x89, 0xfb});             // mov rbx, rdi
+				emit({0x49, 0x89, 0xf4});             // mov r12, rsi
+				emit({0x49, 0x89, 0xd5});             // mov r13, rdx
+			}
+
+			/* Returns eax | high << 32 */
+			void epilogue(uint64_t high)
+			{
+				if (high) {
+					emit({0x48, 0xba});                // mov rdx, high << 32
+					imm64(high << 32);
+					emit({0x48, 0x09, 0xd0});          // or rax, rdx
+				}
+				emit({0x41, 0x5d, 0x41, 0x5c, 0x5b}); // pop r13, r12, rbx
+				emit({0xc3});                         // ret
+			}
+
+			/* Calls fn(edi = eax, esi = ecx), the stack being aligned */
+			void call(AluOp fn)
+			{
+				emit({0x89, 0xc7, 0x89, 0xce});       // mov edi, eax; esi, ecx
+				emit({0x48, 0xb8});                   // mov rax, fn
+				imm64((uint64_t)fn);
+				emit({0xff, 0xd0});                   // call rax
+			}
+
+		private:
+			uint8_t *m_p;
+			uint8_t *m_end;
+			int      m_eax;    // Guest register in eax, or -1
+		};
+	}
+
+	bool Rv32Iss::setJit(bool enable, bool check)
+	{
+		flushBlocks();
+		m_jit_check = check;
+		if (enable && m_jit_cache == NULL) {
+			void *p = mmap(NULL, s_jit_cache_size,
+			               PROT_READ | PROT_WRITE | PROT_EXEC,
+			               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == MAP_FAILED)
+				return false;
+			m_jit_cache = (uint8_t *)p;
+		} else if (!enable && m_jit_cache != NULL) {
+			munmap(m_jit_cache, s_jit_cache_size);
+			m_jit_cache = NULL;
+		}
+		return true;
+	}
+
+	/*\
+	 * Translates the block into the code cache. When it is full, nothing
+	 * is translated any more until the next flushBlocks().
+	\*/
+	bool Rv32Iss::jitCompile(Block &b)
+	{
+		/* Where the block leaves before, or after, an instruction */
+		struct Exit {
+			uint8_t *rel;
+			size_t   i;
+			uint64_t flag;
+		};
+		std::vector<Exit> exits;
+
+		m_jit_used = (m_jit_used + 15) & ~(size_t)15;
+		if (m_jit_used >= s_jit_cache_size)
+			return false;
+		uint8_t *const code = m_jit_cache + m_jit_used;
+		Emitter e(code, m_jit_cache + s_jit_cache_size);
+
+		e.prologue();
+		for (size_t i = 0; i < b.insns.size(); i++) {
+			const DecodedInsn &d = b.insns[i];
+			int      bytes = 0;
+			uint32_t limit = 0;
+
+			switch (d.op) {
+				case INSN_NONE:
+					e.movImm(EAX, d.pc);
+					e.epilogue(i);
+					break;
+
+				case INSN_LUI:
+					e.movImm(EAX, d.imm);
+					e.storeReg(EAX, d.rd);
+					break;
+				case INSN_AUIPC:
+					e.movImm(EAX, d.pc + d.imm);
+					e.storeReg(EAX, d.rd);
+					break;
+				case INSN_JAL:
+					e.movImm(EAX, d.pc + d.length);
+					e.storeReg(EAX, d.rd);
+					e.movImm(EAX, d.pc + d.imm);
+					e.epilogue(i + 1);
+					break;
+				case INSN_JALR:
+					e.loadReg(EAX, d.rs1);
+					e.emit({0x05});                   // add eax, imm
+					e.imm32(d.imm);
+					e.emit({0x25});                   // and eax, ~1
+					e.imm32(~1u);
+					e.movImm(EDX, d.pc + d.length);
+					e.storeReg(EDX, d.rd);
+					e.epilogue(i + 1);
+					break;
+
+				case INSN_BEQ: case INSN_BNE:  case INSN_BLT:
+				case INSN_BGE: case INSN_BLTU: case INSN_BGEU:
+				{
+					static const uint8_t cc[] = {
+						CC_E, CC_NE, CC_L, CC_GE, CC_B, CC_AE
+					};
+					e.loadReg(ECX, d.rs2);
+					e.loadReg(EAX, d.rs1);
+					e.emit({0x39, 0xc8});             // cmp eax, ecx
+					e.movImm(EAX, d.pc + d.length);
+					e.movImm(EDX, d.pc + d.imm);
+					e.emit({0x0f, (uint8_t)(0x40 | cc[d.op - INSN_BEQ]),
+					        0xc2});                   // cmovcc eax, edx
+					e.epilogue(i + 1);
+					break;
+				}
+
+				case INSN_LB: case INSN_LBU:
+				case INSN_SB:
+					bytes = 1;
+					break;
+				case INSN_LH: case INSN_LHU:
+				case INSN_SH:
+					bytes = 2;
+					break;
+				case INSN_LW:
+				case INSN_SW:
+					bytes = 4;
+					break;
+
+				default:
+				{
+					/* eax = x[rs1] op (x[rs2] or imm) */
+					if (d.op >= INSN_ADD)
+						e.loadReg(ECX, d.rs2);
+					else
+						e.movImm(ECX, d.imm);
+					e.loadReg(EAX, d.rs1);
+					switch (d.op) {
+						case INSN_ADDI: case INSN_ADD:
+							e.emit({0x01, 0xc8});
+							break;
+						case INSN_SUB:
+							e.emit({0x29, 0xc8});
+							break;
+						case INSN_SLLI: case INSN_SLL:
+							e.emit({0xd3, 0xe0});     // shl eax, cl
+							break;
+						case INSN_SLTI: case INSN_SLT:
+							e.emit({0x39, 0xc8, 0x0f, 0x9c, 0xc0, 0x0f, 0xb6, 0xc0});
+							break;
+						case INSN_SLTIU: case INSN_SLTU:
+							e.emit({0x39, 0xc8, 0x0f, 0x92, 0xc0, 0x0f, 0xb6, 0xc0});
+							break;
+						case INSN_XORI: case INSN_XOR:
+							e.emit({0x31, 0xc8});
+							break;
+						case INSN_SRLI: case INSN_SRL:
+							e.emit({0xd3, 0xe8});     // shr eax, cl
+							break;
+						case INSN_SRAI: case INSN_SRA:
+							e.emit({0xd3, 0xf8});     // sar eax, cl
+							break;
+						case INSN_ORI: case INSN_OR:
+							e.emit({0x09, 0xc8});
+							break;
+						case INSN_ANDI: case INSN_AND:
+							e.emit({0x21, 0xc8});
+							break;
+						case INSN_MUL:
+							e.emit({0x0f, 0xaf, 0xc1});
+							break;
+						/* 64-bit products, ecx being zero extended */
+						case INSN_MULH:
+							e.emit({0x48, 0x63, 0xc0, 0x48, 0x63, 0xc9});
+							e.emit({0x48, 0x0f, 0xaf, 0xc1, 0x48, 0xc1, 0xe8, 0x20});
+							break;
+						case INSN_MULHSU:
+							e.emit({0x48, 0x63, 0xc0});
+							e.emit({0x48, 0x0f, 0xaf, 0xc1, 0x48, 0xc1, 0xe8, 0x20});
+							break;
+						case INSN_MULHU:
+							e.emit({0x89, 0xc0});     // mov eax, eax
+							e.emit({0x48, 0x0f, 0xaf, 0xc1, 0x48, 0xc1, 0xe8, 0x20});
+							break;
+						/* Division by zero and overflow are not worth inlining */
+						case INSN_DIV:
+							e.call(op_div);
+							break;
+						case INSN_DIVU:
+							e.call(op_divu);
+							break;
+						case INSN_REM:
+							e.call(op_rem);
+							break;
+						case INSN_REMU:
+							e.call(op_remu);
+							break;
+					}
+					e.storeReg(EAX, d.rd);
+					break;
+				}
+			}
+			if (bytes == 0)
+				continue;
+
+			/*\
+			 * Memory access: eax = the offset in the direct memory, the
+			 * block leaving before the instruction, like runBlocks()
+			 * does, when it is outside or misaligned
+			\*/
+			limit = d.op >= INSN_SB ? m_dmi_wsize : m_dmi_size;
+			if (d.op >= INSN_SB)
+				e.loadReg(ECX, d.rs2);
+			e.loadReg(EAX, d.rs1);
+			e.emit({0x05});                           // add eax, imm - base
+			e.imm32(d.imm - m_dmi_base);
+			if (limit < (uint32_t)bytes) {
+				exits.push_back(Exit{e.jmp(), i, s_jit_leave});
+				continue;
+			}
+			e.emit({0x3d});                           // cmp eax, limit - bytes
+			e.imm32(limit - bytes);
+			exits.push_back(Exit{e.jcc(CC_A), i, s_jit_leave});
+			if (bytes > 1) {
+				e.emit({0xa8, (uint8_t)(bytes - 1)}); // test al, bytes - 1
+				exits.push_back(Exit{e.jcc(CC_NE), i, s_jit_leave});
+			}
+
+			switch (d.op) {
+				case INSN_LB:
+					e.emit({0x41, 0x0f, 0xbe, 0x04, 0x04}); // movsx eax, [r12 + rax]
+					break;
+				case INSN_LBU:
+					e.emit({0x41, 0x0f, 0xb6, 0x04, 0x04}); // movzx
+					break;
+				case INSN_LH:
+					e.emit({0x41, 0x0f, 0xbf, 0x04, 0x04});
+					break;
+				case INSN_LHU:
+					e.emit({0x41, 0x0f, 0xb7, 0x04, 0x04});
+					break;
+				case INSN_LW:
+					e.emit({0x41, 0x8b, 0x04, 0x04});       // mov eax, [r12 + rax]
+					break;
+				case INSN_SB:
+					e.emit({0x41, 0x88, 0x0c, 0x04});       // mov [r12 + rax], cl
+					break;
+				case INSN_SH:
+					e.emit({0x66, 0x41, 0x89, 0x0c, 0x04});
+					break;
+				case INSN_SW:
+					e.emit({0x41, 0x89, 0x0c, 0x04});
+					break;
+			}
+			if (d.op < INSN_SB) {
+				e.storeReg(EAX, d.rd);
+				continue;
+			}
+
+			/* Leaves the block after a store into translated code */
+			e.emit({0x89, 0xc1});                     // mov ecx, eax
+			e.emit({0xc1, 0xe9, s_code_page_shift});  // shr ecx, shift
+			e.emit({0x41, 0x80, 0x7c, 0x0d, 0x00, 0x00}); // cmp [r13 + rcx], 0
+			exits.push_back(Exit{e.jcc(CC_NE), i, s_jit_flush});
+		}
+
+		for (size_t k = 0; k < exits.size(); k++) {
+			const DecodedInsn &d = b.insns[exits[k].i];
+			e.patch(exits[k].rel, e.pos());
+			if (exits[k].flag == s_jit_leave) {
+				e.movImm(EAX, d.pc);
+				e.epilogue(exits[k].i | s_jit_leave >> 32);
+			} else {
+				e.movImm(EAX, d.pc + d.length);
+				e.epilogue((exits[k].i + 1) | s_jit_flush >> 32);
+			}
+		}
+
+		if (e.full()) {
+			m_jit_used = s_jit_cache_size;
+			return false;
+		}
+		m_jit_used = e.pos() - m_jit_cache;
+		b.jit = (JitCode)code;
+		return true;
+	}
+#else
+	bool Rv32Iss::setJit(bool enable, bool check)
+	{
+		flushBlocks();
+		m_jit_check = check;
+		return !enable;
+	}
+
+	bool Rv32Iss::jitCompile(Block &b)
+	{
+		return false;
+	}
+#endif
+
+	/*\
+	 * Executes the block with step() and then with its translation, from
+	 * the same state, and aborts if they disagree on the registers, the
+	 * next pc, the instructions retired or the bytes written. step() gets
+	 * its memory accesses done from the direct memory, and stops where
+	 * the translation leaves the block.
+	\*/
+	uint64_t Rv32Iss::jitCheck(Block &b)
+	{
+		uint32_t gpr[32];
+		uint32_t ref_gpr[32];
+		std::vector<std::pair<uint32_t, uint8_t> > undo; // Offset, old byte
+		std::vector<uint8_t> written;
+		uint64_t ref = 0;
+		DataMemory *const data_memory = m_data_memory;
+
+		/* The accesses of step() are done below, with the undo log */
+		m_data_memory = NULL;
+		memcpy(gpr, r_gpr, sizeof(gpr));
+		for (size_t i = 0; i < b.insns.size(); i++) {
+			const DecodedInsn &d = b.insns[i];
+			if (d.op == INSN_NONE) {
+				ref = d.pc | (uint64_t)i << 32;
+				break;
+			}
+			if (d.op >= INSN_LB && d.op <= INSN_SW) {
+				static const uint8_t size[] = { 1, 2, 4, 1, 2, 1, 2, 4 };
+				const uint32_t bytes  = size[d.op - INSN_LB];
+				const uint32_t limit  = d.op >= INSN_SB ? m_dmi_wsize : m_dmi_size;
+				const uint32_t offset = r_gpr[d.rs1] + d.imm - m_dmi_base;
+				if ((uint64_t)offset + bytes > limit || (offset & (bytes - 1))) {
+					ref = d.pc | (uint64_t)i << 32 | s_jit_leave;
+					break;
+				}
+			}
+
+			memcpy(&m_ir, m_dmi + (d.pc - m_dmi_base), 4);
+			m_ibe = false;
+			step();
+
+			if (r_mem_req && r_mem_type == DATA_WRITE) {
+				const uint32_t offset = r_mem_addr - m_dmi_base;
+				const uint32_t word   = offset & ~3u;
+				const uint8_t  be     = ((1 << r_mem_bytes) - 1) << (offset & 3);
+				for (uint32_t k = 0; k < 4; k++) {
+					if (!(be & (1 << k)))
+						continue;
+					undo.push_back(std::make_pair(word + k, m_dmi[word + k]));
+					m_dmi[word + k] = r_mem_wdata >> (8 * k);
+				}
+				/* Not through setDataResponse(), which would flush b */
+				r_mem_req = false;
+				if (m_code_pages[offset >> s_code_page_shift]) {
+					ref = r_pc | (uint64_t)(i + 1) << 32 | s_jit_flush;
+					break;
+				}
+			} else if (r_mem_req) {
+				uint32_t data;
+				memcpy(&data, m_dmi + ((r_mem_addr - m_dmi_base) & ~3u), 4);
+				setDataResponse(false, data);
+			}
+
+			if (d.op >= INSN_JAL && d.op <= INSN_BGEU) {
+				ref = r_pc | (uint64_t)(i + 1) << 32;
+				break;
+			}
+		}
+
+		/* Back to the state before the block */
+		m_data_memory = data_memory;
+		memcpy(ref_gpr, r_gpr, sizeof(ref_gpr));
+		for (size_t k = 0; k < undo.size(); k++)
+			written.push_back(m_dmi[undo[k].first]);
+		for (size_t k = undo.size(); k-- > 0;)
+			m_dmi[undo[k].first] = undo[k].second;
+		memcpy(r_gpr, gpr, sizeof(gpr));
+		r_pc = b.insns[0].pc;
+
+		const uint64_t r = b.jit(r_gpr, m_dmi, m_code_pages.data());
+
+		bool same = r == ref && memcmp(r_gpr, ref_gpr, sizeof(ref_gpr)) == 0;
+		for (size_t k = 0; k < undo.size(); k++)
+			same = same && m_dmi[undo[k].first] == written[k];
+		if (same)
+			return r;
+
+		fprintf(stderr, "Translation of the block at 0x%08x differs from step():\n",
+		        b.insns[0].pc);
+		fprintf(stderr, "  next pc 0x%08x, %u retired, flags 0x%x, expected "
+		        "0x%08x, %u retired, flags 0x%x\n",
+		        (uint32_t)r, (uint32_t)(r >> 32) & 0xffff, (uint32_t)(r >> 62),
+		        (uint32_t)ref, (uint32_t)(ref >> 32) & 0xffff, (uint32_t)(ref >> 62));
+		for (int k = 0; k < 32; k++)
+			if (r_gpr[k] != ref_gpr[k])
+				fprintf(stderr, "  x%d = 0x%08x, expected 0x%08x\n",
+				        k, r_gpr[k], ref_gpr[k]);
+		for (size_t k = 0; k < undo.size(); k++)
+			if (m_dmi[undo[k].first] != written[k])
+				fprintf(stderr, "  byte at 0x%08x = 0x%02x, expected 0x%02x\n",
+				        m_dmi_base + undo[k].first, m_dmi[undo[k].first],
+				        written[k]);
+		abort();
+	}
+} // end common
+} // end soclib
@@ -0,0 +1,83 @@
+/*\
+ * vim: tw=0: cindent: sw=3: ts=3: sts=3: noet: list
+ *
+ * Integer operations of the Rv32 ISS, shared by the decoded instructions
+ * and their translation into host code (see rv32_jit.cpp)
+\*/
+
+#ifndef _SOCLIB_RV32_OPS_H_
+#define _SOCLIB_RV32_OPS_H_
+
+#include <stdint.h>
+
+namespace soclib {
+namespace common {
+namespace rv32_ops {
+	inline uint32_t op_add(uint32_t a, uint32_t b)  { return a + b; }
+	inline uint32_t op_sub(uint32_t a, uint32_t b)  { return a - b; }
+	inline uint32_t op_sll(uint32_t a, uint32_t b)  { return a << (b & 0x1f); }
+	inline uint32_t op_slt(uint32_t a, uint32_t b)  { return (int32_t)a < (int32_t)b; }
+	inline uint32_t op_sltu(uint32_t a, uint32_t b) { return a < b; }
+	inline uint32_t op_xor(uint32_t a, uint32_t b)  { return a ^ b; }
+	inline uint32_t op_srl(uint32_t a, uint32_t b)  { return a >> (b & 0x1f); }
+	inline uint32_t op_sra(uint32_t a, uint32_t b)  { return (int32_t)a >> (b & 0x1f); }
+	inline uint32_t op_or(uint32_t a, uint32_t b)   { return a | b; }
+	inline uint32_t op_and(uint32_t a, uint32_t b)  { return a & b; }
+
+	inline uint32_t op_mul(uint32_t a, uint32_t b)
+	{
+		return a * b;
+	}
+
+	inline uint32_t op_mulh(uint32_t a, uint32_t b)
+	{
+		return ((int64_t)((int32_t)a) * (int32_t)b) >> 32;
+	}
+
+	inline uint32_t op_mulhsu(uint32_t a, uint32_t b)
+	{
+		return ((int64_t)((int32_t)a) * (uint32_t)b) >> 32;
+	}
+
+	inline uint32_t op_mulhu(uint32_t a, uint32_t b)
+	{
+		return ((uint64_t)a * b) >> 32;
+	}
+
+	inline uint32_t op_div(uint32_t a, uint32_t b)
+	{
+		if (!b) // division by zero
+			return -1;
+		if ((int32_t)a == INT32_MIN && (int32_t)b == -1) // overflow
+			return (uint32_t)INT32_MIN;
+		return (int32_t)a / (int32_t)b;
+	}
+
+	inline uint32_t op_divu(uint32_t a, uint32_t b)
+	{
+		return b ? a / b : UINT32_MAX;
+	}
+
+	inline uint32_t op_rem(uint32_t a, uint32_t b)
+	{
+		if (!b) // division by zero
+			return a;
+		if ((int32_t)a == INT32_MIN && (int32_t)b == -1) // overflow
+			return 0;
+		return (int32_t)a % (int32_t)b;
+	}
+
+	inline uint32_t op_remu(uint32_t a, uint32_t b)
+	{
+		return b ? a % b : a;
+	}
+
+	inline uint32_t op_eq(uint32_t a, uint32_t b)   { return a == b; }
+	inline uint32_t op_ne(uint32_t a, uint32_t b)   { return a != b; }
+	inline uint32_t op_ge(uint32_t a, uint32_t b)   { return (int32_t)a >= (int32_t)b; }
+	inline uint32_t op_geu(uint32_t a, uint32_t b)  { return a >= b; }
+}
+}
+}
+
+#endif // _SOCLIB_RV32_OPS_H_
@@ -10,21 +10,25 @@
 #include "ensitlm.h"
 #include "rv32_wrapper.h"
 #include "rv32.h"
+#include <algorithm>
 #include <iomanip>
 
 #if 0
 #define DEBUG
 #endif
+/* Instructions run by run_blocks() between two advances of the time */
 #define NB_INST 50
-static const sc_core::sc_time PERIOD_MULT(20 * NB_INST, sc_core::SC_NS);
 
 /* Time between two step()s */
 static const sc_core::sc_time PERIOD(20, sc_core::SC_NS);
 
+static const uint32_t WFI = 0x10500073;
+
 using namespace std;
 
-RV32Wrapper::RV32Wrapper(sc_core::sc_module_name name)
+RV32Wrapper::RV32Wrapper(sc_core::sc_module_name name, unsigned int batch)
 	: sc_core::sc_module(name), irq("irq"),
+	batch(batch ? batch : 1),
 	m_iss(0) /* identifier, not very useful since we have only one instance */
 {
 	m_iss.reset();
@@ -38,21 +42,147 @@ RV32Wrapper::RV32Wrapper(sc_core::sc_module_name name)
 }
 
 
+void RV32Wrapper::save(std::ostream &os) const
+{
+	put(os, retired);
+	put(os, cmpt);
+	m_iss.saveState(os);
+}
+
+void RV32Wrapper::restore(std::istream &is)
+{
+	get(is, retired);
+	get(is, cmpt);
+	m_iss.restoreState(is);
+}
+
+void RV32Wrapper::use_blocks(bool enable)
+{
+	blocks = enable;
+}
+
+void RV32Wrapper::use_jit(bool enable, bool check)
+{
+	if (!m_iss.setJit(enable, check))
+		std::cerr << name() << ": no translation into host code, "
+		          "interpreting the blocks" << std::endl;
+	if (enable)
+		blocks = true;
+}
+
+void RV32Wrapper::use_sync_memory(bool enable)
+{
+	sync_memory = enable;
+	m_iss.setDataMemory(enable ? this : NULL);
+}
+
+/* An access to something else than memory in a batch: the time of the
+ * instructions run so far, this one included, passes first, so that it
+ * happens when it would with the handshake and one instruction per
+ * batch. The batch ends after this instruction. */
+void RV32Wrapper::sync_mmio(uint32_t addr)
+{
+	if (socket.is_direct(addr))
+		return;
+	socket.advance((batch_run + 1 - batch_waited) * PERIOD);
+	batch_waited = batch_run + 1;
+	mmio = true;
+}
+
+/* Errors are only reported, as in exec_data_request() */
+bool RV32Wrapper::readData(uint32_t addr, uint32_t &rdata)
+{
+	sync_mmio(addr);
+	if (socket.read(addr, rdata) != tlm::TLM_OK_RESPONSE)
+		std::cerr << "Read error in address " << hex << addr << std::endl;
+	return true;
+}
+
+bool RV32Wrapper::writeData(uint32_t addr, uint32_t wdata, uint8_t be)
+{
+	tlm::tlm_response_status status;
+	sync_mmio(addr);
+	if (be == 0xf)
+		status = socket.write(addr, wdata);
+	else
+		status = socket.write_masked(addr, wdata, be);
+	if (status != tlm::TLM_OK_RESPONSE)
+		std::cerr << "Write error in address " << hex << addr << std::endl;
+	return true;
+}
+
+void RV32Wrapper::invalidate_direct_mem_ptr(sc_dt::uint64 start,
+                                            sc_dt::uint64 end)
+{
+	m_iss.setDirectMemory(NULL, 0, 0, false);
+	dmi_asked = false;
+}
+
+/* Gives the memory holding the code to the ISS, asked once until
+ * invalidated, for the blocks and the synchronous accesses */
+void RV32Wrapper::ask_dmi(void)
+{
+	if (dmi_asked)
+		return;
+	tlm::tlm_dmi dmi;
+	uint32_t pc = m_iss.getDebugPC();
+	dmi_asked = true;
+	if (socket.get_direct_mem_ptr(pc, dmi) && dmi.is_read_allowed())
+		m_iss.setDirectMemory(dmi.get_dmi_ptr(),
+		                      dmi.get_start_address(),
+		                      dmi.get_end_address() -
+		                          dmi.get_start_address() + 1,
+		                      dmi.is_write_allowed());
+}
+
+/* Executes blocks of instructions, and returns false when the next
+ * instruction has to go through step(). The memory accesses of the blocks
+ * take no time: the wrapper only advances by PERIOD per instruction. */
+bool RV32Wrapper::run_blocks(void)
+{
+	ask_dmi();
+	uint32_t n = m_iss.runBlocks(NB_INST);
+	if (n == 0)
+		return false;
+	retired += n;
+	cmpt += n;
+	if (cmpt > 3) m_iss.setIrq(false);
+	socket.advance(n * PERIOD);
+	return true;
+}
+
 void RV32Wrapper::irq_handler(void){
 	m_iss.setIrq(true);
 	cmpt = 0;
+	irq_changed = true;
+}
+
+void RV32Wrapper::end_of_simulation()
+{
+	if (batches == 0)
+		return;
+	/* In the one-instruction mode, the n-th instruction of a batch would
+	 * have done its accesses (n - 1) * PERIOD later, and an interrupt
+	 * raised during a batch would have been seen that much earlier */
+	cout << "Info: " << name() << ": " << batched << " instructions in "
+	     << batches << " batches of up to " << batch_max << endl;
+	cout << "Info: " << name() << ": accesses "
+	     << PERIOD * (double(batch_shift) / batched)
+	     << " early on average (at most " << PERIOD * (batch_max - 1)
+	     << "), interrupts up to " << PERIOD * (batch_max - 1)
+	     << " late" << endl;
 }
 void RV32Wrapper::exec_data_request(enum iss_t::DataOperationType mem_type,
                                     uint32_t mem_addr, uint32_t mem_wdata, uint32_t mem_be)
 {
 	uint32_t localbuf;
-	int      shift;
 	tlm::tlm_response_status status;
 
 	switch (mem_type) {
     case iss_t::DATA_READ:
-			// read data in the address mem_addr (The ISS requested a data read)
-			status = socket.read(mem_addr, localbuf);
+			// read the word containing mem_addr (The ISS requested a data read),
+			// the ISS extracts the bytes it needs from it
+			status = socket.read(mem_addr & ~3u, localbuf);
 			if (status != tlm::TLM_OK_RESPONSE ){
                 std::cerr << "Read error in address " << hex << mem_addr << std::endl;
 			}
@@ -64,7 +194,12 @@ void RV32Wrapper::exec_data_request(enum iss_t::DataOperationType mem_type,
 			break;
 		case iss_t::DATA_WRITE:
 			// write data in the address mem_addr to the mem_wdata (The ISS requested a data write)
-			status = socket.write(mem_addr, mem_wdata);
+			// mem_wdata is replicated on all the byte lanes, mem_be tells
+			// which bytes of the word are actually written
+			if (mem_be == 0xf)
+				status = socket.write(mem_addr, mem_wdata);
+			else
+				status = socket.write_masked(mem_addr & ~3u, mem_wdata, mem_be);
 			if (status != tlm::TLM_OK_RESPONSE ){
 				std::cerr << "Write error in address " << hex << mem_addr << std::endl;
 			}
@@ -83,45 +218,89 @@ void RV32Wrapper::exec_data_request(enum iss_t::DataOperationType mem_type,
 	}
 }
 
+/* Executes one instruction, and returns false when the batch has to end
+ * after it: the instruction waits for an interrupt, the interrupt line
+ * changed during its accesses, or the next data access is not known to
+ * go to memory (MMIO, to be done at the right time). */
+bool RV32Wrapper::step_iss(void)
+{
+	bool ins_asked;
+	uint32_t ins_addr;
+	uint32_t localbuf = 0;
+	tlm::tlm_response_status status;
+	mmio = false;
+	if (sync_memory)
+		ask_dmi();
+	m_iss.getInstructionRequest(ins_asked, ins_addr);
+
+	if (ins_asked) {
+		/* The ISS requested an instruction.
+		 * We have to do the instruction fetch by reading from memory. */
+		
+		status = socket.read(ins_addr, localbuf);
+		if (status != tlm::TLM_OK_RESPONSE ){
+		std::cerr << "Fetch error in address " << hex << ins_addr << std::endl;
+		}
+		m_iss.setInstruction(0, localbuf);
+	}
+
+	bool mem_asked;
+	enum iss_t::DataOperationType mem_type;
+	uint32_t mem_addr;
+	uint32_t mem_wdata;
+	uint8_t mem_be;
+	m_iss.getDataRequest(mem_asked, mem_type, mem_addr, mem_wdata, mem_be);
+
+	if (mem_asked) {
+		exec_data_request(mem_type, mem_addr, mem_wdata, mem_be);
+	}
+	m_iss.step();
+	retired++;
+
+	/* IRQ handling */
+	cmpt++;
+	if (cmpt > 3) m_iss.setIrq(false);
+
+	if (localbuf == WFI || irq_changed || mmio)
+		return false;
+	m_iss.getDataRequest(mem_asked, mem_type, mem_addr, mem_wdata, mem_be);
+	return !mem_asked || socket.is_direct(mem_addr);
+}
+
+/* Runs batches of up to batch instructions, then lets the time pass for
+ * all of them at once. Their accesses happen at the beginning of the
+ * batch instead of PERIOD after each other, except the MMIO ones which
+ * start a new batch (see end_of_simulation() for the difference). */
 void RV32Wrapper::run_iss(void){
 	while (true) {
-		if (m_iss.isBusy())
+		if (blocks && run_blocks())
+			continue;
+		unsigned int &n = batch_run;
+		n = batch_waited = 0;
+		irq_changed = false;
+		if (m_iss.isBusy()) {
 			m_iss.nullStep();
-		else {
-			bool ins_asked;
-			uint32_t ins_addr;
-			tlm::tlm_response_status status;
-			m_iss.getInstructionRequest(ins_asked, ins_addr);
-
-			if (ins_asked) {
-				uint32_t localbuf;
-				/* The ISS requested an instruction.
-				 * We have to do the instruction fetch by reading from memory. */
-				
-				status = socket.read(ins_addr, localbuf);
-				if (status != tlm::TLM_OK_RESPONSE ){
-				std::cerr << "Fetch error in address " << hex << ins_addr << std::endl;
-				}
-				m_iss.setInstruction(0, localbuf);
-			}
-
-			bool mem_asked;
-			enum iss_t::DataOperationType mem_type;
-			uint32_t mem_addr;
-			uint32_t mem_wdata;
-			uint8_t mem_be;
-			m_iss.getDataRequest(mem_asked, mem_type, mem_addr, mem_wdata, mem_be);
-
-			if (mem_asked) {
-				exec_data_request(mem_type, mem_addr, mem_wdata, mem_be);
+			n = 1;
+		} else {
+			/* Back to the blocks as soon as possible */
+			const unsigned int max = blocks ? 1 : batch;
+			while (n < max) {
+				const bool more = step_iss();
+				n++;
+				if (!more)
+					break;
 			}
-			m_iss.step();
+		}
 
-			/* IRQ handling */
-			cmpt++;
-			if (cmpt > 3) m_iss.setIrq(false);
+		if (batch > 1) {
+			batches++;
+			batched += n;
+			batch_shift += uint64_t(n) * (n - 1) / 2;
+			batch_max = std::max(batch_max, n);
 		}
 
-		wait(PERIOD);
+		/* Only actually waits when the socket is not loosely-timed */
+		if (n > batch_waited)
+			socket.advance((n - batch_waited) * PERIOD);
 	}
 }
@@ -3,11 +3,13 @@
 
 #include "ensitlm.h"
 #include "rv32.h"
+#include "checkpoint.h"
 
 /*\
  * Wrapper for the RISCV ISS using the ensitlm protocol.
 \*/
-struct RV32Wrapper : sc_core::sc_module {
+struct RV32Wrapper : sc_core::sc_module, checkpointable,
+                     soclib::common::Rv32Iss::DataMemory {
 	ensitlm::initiator_socket<RV32Wrapper> socket;
 	sc_core::sc_in<bool> irq;
 
@@ -15,11 +17,60 @@ struct RV32Wrapper : sc_core::sc_module {
 	/* Add stuff relative to irq handling */
 	void irq_handler(void);
 	int cmpt = 3; /* cycles counter */
+	/* Instructions executed so far (see SimSpeed) */
+	uint64_t retired = 0;
 
-	SC_CTOR(RV32Wrapper);
+	SC_HAS_PROCESS(RV32Wrapper);
+	/* Runs up to batch instructions before letting the time pass for
+	 * all of them at once (see run_iss()) */
+	explicit RV32Wrapper(sc_core::sc_module_name name,
+	                     unsigned int batch = 1);
+
+	/* Reports the time shift due to the batches */
+	void end_of_simulation();
+
+	/* State of the ISS, between two instructions */
+	void save(std::ostream &os) const;
+	void restore(std::istream &is);
+
+	/* Run the code by blocks of instructions, directly from the memory
+	 * (through DMI), between the instructions which need step() */
+	void use_blocks(bool enable);
+
+	/* Also translate the hot blocks into host code, checking each of
+	 * them against step() when check is true (slow) */
+	void use_jit(bool enable, bool check);
+
+	/* Let the ISS do its data accesses within step(), through readData()
+	 * and writeData(), instead of asking for them */
+	void use_sync_memory(bool enable);
+	bool readData(uint32_t addr, uint32_t &rdata);
+	bool writeData(uint32_t addr, uint32_t wdata, uint8_t be);
+
+	/* Called by the socket when a target invalidates its DMI pointers */
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end);
 
 private:
 	typedef soclib::common::Rv32Iss iss_t;
+	void ask_dmi(void);
+	bool run_blocks(void);
+	bool step_iss(void);
+	void sync_mmio(uint32_t addr);
+	const unsigned int batch;
+	/* Instructions of the current batch run, and already waited for */
+	unsigned int batch_run = 0;
+	unsigned int batch_waited = 0;
+	bool irq_changed = false;
+	bool mmio = false;
+	/* Batches run, and the sum of the instructions' positions in them,
+	 * which tells how early their accesses are */
+	uint64_t batches = 0;
+	uint64_t batched = 0;
+	uint64_t batch_shift = 0;
+	unsigned int batch_max = 0;
+	bool blocks = false;
+	bool sync_memory = false;
+	bool dmi_asked = false; /* DMI requested, see ask_dmi() */
 	void exec_data_request(enum iss_t::DataOperationType mem_type,
 	                       uint32_t mem_addr, uint32_t mem_wdata, uint32_t mem_be);
 	iss_t m_iss;
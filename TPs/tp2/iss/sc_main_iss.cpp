@@ -9,8 +9,14 @@
 #include "vga.h"
 #include "intc.h"
 #include "gpio.h"
+#include "sim-speed.h"
+#include "checkpoint.h"
+
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "../address_map.h"
+#include "../platform_bus.h"
 
 #include "../elf-loader/loader/include/loader.h"
 #include "../elf-loader/loader/include/exception.h"
@@ -23,35 +29,155 @@ namespace common {
 };
 #define SOFT_SIZE 0xB000
 
-int sc_main(int, char **) {
-	RV32Wrapper cpu("risc-v");
+// When not 0, the VGA controller fetches its frames in approximately-
+// timed mode, with up to VGA_DEPTH reads outstanding. The bus and
+// frame rate statistics are printed at the end of the simulation.
+// Bus completes these transactions at once: use FastBus instead for
+// the phases to go through to the memory.
+static const unsigned int VGA_DEPTH = 0;
+
+static void usage(const char *argv0) {
+	std::cerr << "Usage: " << argv0
+	          << " [-q ns] [-n batch] [-m] [-b] [-j|-J] "
+	             "[-s checkpoint -t ms] [-r checkpoint]\n"
+	          << "  -q: loosely-timed CPU, up to ns ns ahead of the "
+	             "platform\n"
+	          << "  -n: run up to batch instructions per advance of the "
+	             "time\n"
+	          << "  -m: do the data accesses within the ISS step\n"
+	          << "  -b: run the code by blocks of instructions\n"
+	          << "  -j: also translate the hot blocks into host code\n"
+	          << "  -J: same, checking each block against the "
+	             "interpreter\n"
+	          << "  -s, -t: save the platform state after ms ms of "
+	             "simulated time\n"
+	          << "  -r: start from a saved state instead of the ELF file"
+	          << std::endl;
+	exit(1);
+}
+
+int sc_main(int argc, char **argv) {
+	const char *save_file = NULL;
+	const char *restore_file = NULL;
+	double save_ms = 0;
+	double quantum_ns = 0;
+	bool sync_memory = false;
+	bool blocks = false;
+	bool jit = false;
+	bool jit_check = false;
+	unsigned int batch = 1;
+	int opt;
+	while ((opt = getopt(argc, argv, "q:n:mbjJs:t:r:")) != -1) {
+		switch (opt) {
+		case 'q':
+			quantum_ns = strtod(optarg, NULL);
+			break;
+		case 'n':
+			batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			sync_memory = true;
+			break;
+		case 'b':
+			blocks = true;
+			break;
+		case 'J':
+			jit_check = true;
+			// fall through
+		case 'j':
+			jit = true;
+			break;
+		case 's':
+			save_file = optarg;
+			break;
+		case 't':
+			save_ms = strtod(optarg, NULL);
+			break;
+		case 'r':
+			restore_file = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	RV32Wrapper cpu("risc-v", batch);
+	cpu.use_sync_memory(sync_memory);
+	cpu.use_blocks(blocks);
+	if (jit)
+		cpu.use_jit(true, jit_check);
 	Memory inst_ram("inst_ram", INST_RAM_SIZE);
+	// Use "PlatformBus bus("bus");" to resolve the address map at
+	// compile time (see platform_bus.h).
 	Bus bus("bus");
+	// Uncomment to record the bus transactions, to be analyzed with
+	// tools/trace-analyzer.x (this disables DMI, hence is slower).
+	// bus.record_to("bus.trc");
+	// Uncomment to model the contention between the CPU and the VGA
+	// controller for the bus (also disables DMI):
+	// bus.set_timing(sc_core::sc_time(10, sc_core::SC_NS));
+	// bus.set_wait_states(inst_ram.target, 1);
 	TIMER timer("timer", sc_core::sc_time(20, sc_core::SC_NS));
 	// declare the UART peripheral
 	UART uart("uart");
 	Vga vga("vga");
 	Intc intc("intc");
 	Gpio gpio("gpio");
+	// Prints the simulation speed every 10 s of host time, and at the
+	// end of the simulation.
+	SimSpeed speed("speed", 10);
+	Checkpoint checkpoint("checkpoint");
+	checkpoint.add(cpu);
+	checkpoint.add(inst_ram);
+	checkpoint.add(timer);
+	checkpoint.add(vga);
+	checkpoint.add(intc);
+	checkpoint.add(gpio);
 
 	sc_core::sc_signal<bool> timer_irq("timer_irq");
 	sc_core::sc_signal<bool> vga_irq("vga_irq");
 	sc_core::sc_signal<bool> cpu_irq("cpu_irq");
 
-	// Load the program in RAM
+	if (save_file)
+		checkpoint.save_at(save_file,
+		                   sc_core::sc_time(save_ms, sc_core::SC_MS));
+
+	// Load the program in RAM, unless restoring a checkpoint
 	soclib::common::Loader::register_loader("elf", soclib::common::elf_load);
-	try {
-		soclib::common::Loader loader("../software/cross/a.out");
-		loader.load(inst_ram.storage, 0x80000000, SOFT_SIZE);
-		for (int i = 0; i < SOFT_SIZE / 4; i++) {
-			inst_ram.storage[i] = uint32_le_to_machine(inst_ram.storage[i]);
+	if (restore_file) {
+		if (!checkpoint.restore(restore_file)) {
+			std::cerr << "cannot restore " << restore_file
+			          << std::endl;
+			return 1;
+		}
+	} else {
+		try {
+			soclib::common::Loader loader("../software/cross/a.out");
+			loader.load(inst_ram.storage, 0x80000000, SOFT_SIZE);
+			for (int i = 0; i < SOFT_SIZE / 4; i++) {
+				inst_ram.storage[i] = uint32_le_to_machine(inst_ram.storage[i]);
+			}
+		} catch (soclib::exception::RunTimeError &e) {
+			std::cerr << "unable to load ELF file in memory:" << std::endl;
+			std::cerr << e.what() << std::endl;
+			abort();
 		}
-	} catch (soclib::exception::RunTimeError &e) {
-		std::cerr << "unable to load ELF file in memory:" << std::endl;
-		std::cerr << e.what() << std::endl;
-		abort();
 	}
 
+	// Temporal decoupling: the CPU may run ahead of the rest of the
+	// platform by up to one quantum before synchronizing with the
+	// SystemC kernel. Larger values run faster, but delay the
+	// interrupts seen by the CPU.
+	if (quantum_ns > 0) {
+		tlm_utils::tlm_quantumkeeper::set_global_quantum(
+		    sc_core::sc_time(quantum_ns, sc_core::SC_NS));
+		cpu.socket.set_loosely_timed(true);
+	}
+	if (VGA_DEPTH)
+		vga.initiator.set_approximately_timed(true, VGA_DEPTH);
+
 	// initiators
 	cpu.socket.bind(bus.target);
 	vga.initiator(bus.target);
@@ -74,6 +200,9 @@ int sc_main(int, char **) {
 	intc.out(cpu_irq);
 	cpu.irq(cpu_irq);
 
+	speed.count_instructions(cpu.retired);
+	speed.count_transactions(bus.target.statistics());
+
 	//      port             start addr         size
 	bus.map(inst_ram.target, INST_RAM_BASEADDR, INST_RAM_SIZE);
 	bus.map(vga.target,      VGA_BASEADDR,      VGA_SIZE);
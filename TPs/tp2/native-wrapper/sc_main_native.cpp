@@ -8,6 +8,7 @@
 #include "vga.h"
 #include "intc.h"
 #include "gpio.h"
+#include "sim-speed.h"
 
 int sc_main(int, char**)
 {
@@ -18,6 +19,10 @@ int sc_main(int, char**)
 	Vga vga("vga");
 	Intc intc("intc");
 	Gpio gpio("gpio");
+	// Prints the simulation speed every 10 s of host time, and at the
+	// end of the simulation. The native software has no instruction
+	// count.
+	SimSpeed speed("speed", 10);
 
 	sc_core::sc_signal<bool> timer_irq("timer_irq");
 	sc_core::sc_signal<bool> vga_irq("vga_irq");
@@ -43,6 +48,11 @@ int sc_main(int, char**)
 	intc.out(cpu_irq);
 	cpu.irq(cpu_irq);
 
+	speed.count_transactions(bus.target.statistics());
+
+	// The software writes the frame buffer word by word: with true as
+	// a fourth argument for inst_ram, the bus posts these writes and
+	// merges them into blocks (see bus.h).
 	//      port             start addr         size
 	bus.map(inst_ram.target, INST_RAM_BASEADDR, INST_RAM_SIZE);
 	bus.map(vga.target,      VGA_BASEADDR,      VGA_SIZE);
@@ -0,0 +1,26 @@
+#ifndef PLATFORM_BUS_H
+#define PLATFORM_BUS_H
+
+#include "static_bus.h"
+
+#include "address_map.h"
+#include "memory.h"
+#include "gpio.h"
+#include "intc.h"
+#include "timer.h"
+#include "uart.h"
+#include "vga.h"
+
+// Bus of the platform, with the address map of address_map.h resolved
+// at compile time. Can replace Bus in sc_main: targets are bound and
+// mapped the same way.
+typedef ensitlm::StaticBus<
+    ensitlm::static_mapping<Memory, INST_RAM_BASEADDR, INST_RAM_SIZE>,
+    ensitlm::static_mapping<Vga, VGA_BASEADDR, VGA_SIZE>,
+    ensitlm::static_mapping<Gpio, GPIO_BASEADDR, GPIO_SIZE>,
+    ensitlm::static_mapping<UART, UART_BASEADDR, UART_SIZE>,
+    ensitlm::static_mapping<TIMER, TIMER_BASEADDR, TIMER_SIZE>,
+    ensitlm::static_mapping<Intc, INTC_BASEADDR, INTC_SIZE> >
+    PlatformBus;
+
+#endif
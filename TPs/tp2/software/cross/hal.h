@@ -35,7 +35,7 @@ static inline void enable_interrupts(void) {
 /* printf and puts are disabled, for now ... */
 #define printf(s)               \
 {									\
-      int word_cmpt, char_cmpt = 0;  \
+      int word_cmpt = 0, char_cmpt = 0;  \
 		uint32_t base_addr = ((uint32_t)s) & ~0x3;   \
 		uint32_t word = hal_read32(base_addr);                \
     	uint32_t character = (word >> 0 * 8) & 0xFF;           \